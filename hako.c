@@ -5,6 +5,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include "version.h"
 #include "wasi_version.h"
@@ -39,6 +40,12 @@ HAKO_IMPORT("call_function")
 JSValue *host_call_function(JSContext *ctx, JSValueConst *this_ptr, int32_t argc,
                             JSValueConst *argv, uint32_t magic_func_id);
 
+HAKO_IMPORT("call_function_packed")
+extern void host_call_function_packed(JSContext *ctx, int32_t argc,
+                                      HakoValueSlot *argv_slots,
+                                      HakoValueSlot *result_slot,
+                                      uint32_t func_id);
+
 HAKO_IMPORT("interrupt_handler")
 extern int32_t host_interrupt_handler(JSRuntime *rt, JSContext *ctx, void *opaque);
 
@@ -47,6 +54,11 @@ extern HakoModuleSource *host_load_module(JSRuntime *rt, JSContext *ctx,
                                           const char *module_name, void *opaque,
                                           JSValueConst *attributes);
 
+HAKO_IMPORT("fetch_module")
+extern void host_fetch_module(JSRuntime *rt, JSContext *ctx,
+                              const char *module_name, uint32_t token,
+                              void *opaque);
+
 HAKO_IMPORT("normalize_module")
 extern char *host_normalize_module(JSRuntime *rt, JSContext *ctx,
                                    const char *module_base_name,
@@ -93,6 +105,162 @@ static inline JS_BOOL is_static_constant(const JSValue *ptr) {
          ptr == (JSValue *)&HAKO_False || ptr == (JSValue *)&HAKO_True;
 }
 
+/* Handle table: generational indices into a per-context JSValue slab. The
+   low bits of a handle select the slot, the high bits carry the slot
+   generation so that stale handles are detected instead of aliasing a
+   newer value. Slots below HAKO_HANDLE_FIRST_DYNAMIC are reserved for the
+   constants, which are served from hako_handle_constants so that they
+   resolve before the table is allocated. */
+#define HAKO_HANDLE_INDEX_BITS 24
+#define HAKO_HANDLE_INDEX_MASK ((1U << HAKO_HANDLE_INDEX_BITS) - 1)
+#define HAKO_HANDLE_GEN_MASK 0xff
+#define HAKO_HANDLE_FIRST_DYNAMIC 6
+#define HAKO_HANDLE_INITIAL_SIZE 64
+
+typedef struct HakoHandleSlot {
+  JSValue value;
+  uint32_t gen;       /* generation, 0 for the constant slots */
+  uint32_t next_free; /* next slot in the free list, 0 if none */
+} HakoHandleSlot;
+
+typedef struct HakoHandleTable {
+  HakoHandleSlot *slots;
+  uint32_t size;      /* allocated slots */
+  uint32_t used;      /* slots ever handed out (high water mark) */
+  uint32_t free_head; /* first free slot, 0 if none */
+  uint32_t live;      /* live dynamic handles */
+} HakoHandleTable;
+
+/* Asynchronous module loader. A load waits for the static import graph of
+   its root module: every module of the graph is fetched by the host in
+   parallel, compiled into the context as it arrives, and the root is
+   evaluated once nothing is missing. */
+typedef struct HakoModuleFetch {
+  uint32_t token;
+  char *name; /* normalized module name */
+} HakoModuleFetch;
+
+typedef struct HakoModuleLoad {
+  char *base_name;
+  char *specifier;
+  char *name; /* normalized root module name */
+  JSValue resolving_funcs[2];
+} HakoModuleLoad;
+
+typedef struct HakoModuleFailure {
+  char *name;
+  JSValue reason;
+} HakoModuleFailure;
+
+typedef struct HakoModuleLoader {
+  HakoModuleFetch *fetches; /* in flight */
+  int32_t fetch_count;
+  int32_t fetch_size;
+  HakoModuleLoad *loads; /* waiting for their graph, in start order */
+  int32_t load_count;
+  int32_t load_size;
+  /* fetches that failed since the outermost pump started */
+  HakoModuleFailure *failures;
+  int32_t failure_count;
+  int32_t failure_size;
+  uint32_t next_token;
+  int32_t pumping;
+  int32_t dirty;
+} HakoModuleLoader;
+
+/* Per-context state owned by Hako, stored in the context opaque. The host
+   data set with HAKO_SetContextData lives here too. */
+typedef struct HakoContext {
+  void *host_data;
+  HakoHandleTable handles;
+  /* pristine state of pooled contexts, NULL otherwise */
+  JSContextSnapshot *snapshot;
+  /* fuel consumed by the last top-level eval or call */
+  int64_t last_call_fuel;
+  HakoModuleLoader loader;
+} HakoContext;
+
+static inline HakoContext *hako_context(JSContext *ctx) {
+  return JS_GetContextOpaque(ctx);
+}
+
+static void hako_module_loader_free(JSContext *ctx, HakoModuleLoader *loader);
+static void hako_context_detach(JSContext *ctx);
+
+static inline void hako_fuel_record(JSContext *ctx, int64_t fuel_start) {
+  hako_context(ctx)->last_call_fuel = JS_GetFuelUsed(ctx) - fuel_start;
+}
+
+static uint64_t hako_monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Scope arena: while a scope is open, boxed JSValue results are bump
+   allocated from fixed size chunks instead of js_malloc. Closing a scope
+   frees every value allocated since it was opened and rewinds the bump
+   pointer; the chunks themselves are kept for the next scope. */
+#define HAKO_SCOPE_CHUNK_BITS 8
+#define HAKO_SCOPE_CHUNK_SIZE (1U << HAKO_SCOPE_CHUNK_BITS)
+
+typedef struct HakoScopeArena {
+  JSValue **chunks;
+  uint32_t chunk_count;
+  uint32_t chunk_size; /* allocated entries in chunks */
+  uint32_t top;        /* slots in use across all chunks */
+  /* address range spanned by the chunks */
+  const JSValue *lo;
+  const JSValue *hi;
+  uint32_t *marks;     /* value of top when each open scope was opened */
+  uint32_t depth;
+  uint32_t marks_size;
+} HakoScopeArena;
+
+/* Bytecode of modules compiled from source, shared by all contexts of a
+   runtime. Entries are keyed by a hash over the module name and source
+   and checked against the name, the full source text and the strip
+   flags: the hash is not collision resistant and the cache is shared
+   between tenants. */
+typedef struct HakoModuleCacheEntry {
+  struct HakoModuleCacheEntry *next;
+  uint64_t key_hash;
+  size_t source_len;
+  int32_t strip_flags;
+  char *name;
+  char *source;
+  uint8_t *bytecode;
+  size_t bytecode_len;
+} HakoModuleCacheEntry;
+
+typedef struct HakoModuleCache {
+  int32_t enabled;
+  HakoModuleCacheEntry **buckets;
+  uint32_t bucket_count; /* 0 or a power of two */
+  uint32_t count;
+  uint64_t bytes;
+  uint64_t hits;
+  uint64_t misses;
+} HakoModuleCache;
+
+/* Per-runtime state owned by Hako, stored in the runtime opaque. */
+typedef struct HakoRuntime {
+  ts_strip_ctx_t *type_stripper;
+  HakoScopeArena scopes;
+  /* NUL terminated copy of JSON slices without slack, reused across calls */
+  char *json_scratch;
+  size_t json_scratch_size;
+  HakoModuleCache module_cache;
+  HakoInterruptState interrupt;
+  int32_t interrupt_call_host;
+  void *interrupt_opaque;
+  void *module_fetch_opaque;
+} HakoRuntime;
+
+static inline HakoRuntime *hako_runtime(JSRuntime *rt) {
+  return JS_GetRuntimeOpaque(rt);
+}
+
 static void* ts_strip_malloc_wrapper(void* user_data, size_t size) {
   JSRuntime* rt = (JSRuntime*)user_data;
   if (!rt) return NULL;
@@ -198,17 +366,178 @@ done:
   return ret;
 }
 
+/* FNV-1a */
+static uint64_t hako_hash_bytes(uint64_t h, const void *buf, size_t len) {
+  const uint8_t *p = buf;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    h ^= p[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+static uint64_t hako_module_cache_key(const char *name, const char *source,
+                                      size_t source_len) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  h = hako_hash_bytes(h, name, strlen(name) + 1);
+  return hako_hash_bytes(h, source, source_len);
+}
+
+static HakoModuleCacheEntry **hako_module_cache_find(
+    HakoModuleCache *cache, uint64_t key_hash, const char *name,
+    const char *source, size_t source_len, int32_t strip_flags) {
+  HakoModuleCacheEntry **pe;
+
+  if (cache->bucket_count == 0)
+    return NULL;
+  pe = &cache->buckets[key_hash & (cache->bucket_count - 1)];
+  for (; *pe; pe = &(*pe)->next) {
+    if ((*pe)->key_hash == key_hash && (*pe)->source_len == source_len &&
+        (*pe)->strip_flags == strip_flags && !strcmp((*pe)->name, name) &&
+        !memcmp((*pe)->source, source, source_len))
+      return pe;
+  }
+  return pe;
+}
+
+static JS_BOOL hako_module_cache_has(JSRuntime *rt, const char *name,
+                                     const char *source, size_t source_len) {
+  HakoModuleCache *cache = &hako_runtime(rt)->module_cache;
+  HakoModuleCacheEntry **pe;
+
+  if (!cache->enabled)
+    return FALSE;
+  pe = hako_module_cache_find(cache,
+                              hako_module_cache_key(name, source, source_len),
+                              name, source, source_len, JS_GetStripInfo(rt));
+  return pe && *pe;
+}
+
+static void hako_module_cache_free_entry(JSRuntime *rt,
+                                         HakoModuleCacheEntry *e) {
+  js_free_rt(rt, e->name);
+  js_free_rt(rt, e->source);
+  js_free_rt(rt, e->bytecode);
+  js_free_rt(rt, e);
+}
+
+static void hako_module_cache_clear(JSRuntime *rt, HakoModuleCache *cache) {
+  HakoModuleCacheEntry *e, *next;
+  uint32_t i;
+
+  for (i = 0; i < cache->bucket_count; i++) {
+    for (e = cache->buckets[i]; e; e = next) {
+      next = e->next;
+      hako_module_cache_free_entry(rt, e);
+    }
+  }
+  js_free_rt(rt, cache->buckets);
+  cache->buckets = NULL;
+  cache->bucket_count = 0;
+  cache->count = 0;
+  cache->bytes = 0;
+}
+
+static int hako_module_cache_grow(JSRuntime *rt, HakoModuleCache *cache) {
+  HakoModuleCacheEntry **buckets, *e, *next;
+  uint32_t i, new_count = cache->bucket_count ? cache->bucket_count * 2 : 16;
+
+  buckets = js_mallocz_rt(rt, sizeof(buckets[0]) * new_count);
+  if (!buckets)
+    return -1;
+  for (i = 0; i < cache->bucket_count; i++) {
+    for (e = cache->buckets[i]; e; e = next) {
+      next = e->next;
+      e->next = buckets[e->key_hash & (new_count - 1)];
+      buckets[e->key_hash & (new_count - 1)] = e;
+    }
+  }
+  js_free_rt(rt, cache->buckets);
+  cache->buckets = buckets;
+  cache->bucket_count = new_count;
+  return 0;
+}
+
+/* Best effort: a module that cannot be cached is still loaded. */
+static void hako_module_cache_put(JSContext *ctx, HakoModuleCache *cache,
+                                  uint64_t key_hash, const char *name,
+                                  const char *source, size_t source_len,
+                                  int32_t strip_flags,
+                                  JSValueConst module_val) {
+  JSRuntime *rt = JS_GetRuntime(ctx);
+  HakoModuleCacheEntry *e, **pe;
+  uint8_t *bytecode;
+  size_t bytecode_len;
+
+  if (cache->count >= cache->bucket_count &&
+      hako_module_cache_grow(rt, cache) < 0)
+    return;
+  bytecode = JS_WriteObject(ctx, &bytecode_len, module_val,
+                            JS_WRITE_OBJ_BYTECODE);
+  if (!bytecode) {
+    JS_FreeValue(ctx, JS_GetException(ctx));
+    return;
+  }
+  e = js_mallocz_rt(rt, sizeof(*e));
+  if (!e || !(e->name = js_malloc_rt(rt, strlen(name) + 1)) ||
+      !(e->source = js_malloc_rt(rt, source_len + 1))) {
+    if (e)
+      js_free_rt(rt, e->name);
+    js_free_rt(rt, e);
+    js_free_rt(rt, bytecode);
+    return;
+  }
+  strcpy(e->name, name);
+  memcpy(e->source, source, source_len);
+  e->key_hash = key_hash;
+  e->source_len = source_len;
+  e->strip_flags = strip_flags;
+  e->bytecode = bytecode;
+  e->bytecode_len = bytecode_len;
+  pe = &cache->buckets[key_hash & (cache->bucket_count - 1)];
+  e->next = *pe;
+  *pe = e;
+  cache->count++;
+  cache->bytes += bytecode_len + source_len;
+}
+
 static JSModuleDef *hako_compile_module(JSContext *ctx, const char *module_name,
-                                        const char *module_body) {
+                                        const char *module_body,
+                                        JS_BOOL resolve) {
+  JSRuntime *rt = JS_GetRuntime(ctx);
+  HakoModuleCache *cache = &hako_runtime(rt)->module_cache;
+  HakoModuleCacheEntry **pe = NULL;
+  size_t body_len = strlen(module_body);
+  int32_t strip_flags = JS_GetStripInfo(rt);
+  uint64_t key_hash = 0;
   int32_t eval_flags;
   JSValue func_val = JS_UNDEFINED;
   JSModuleDef *module = NULL;
 
-  eval_flags =
-      JS_EVAL_TYPE_MODULE | JS_EVAL_FLAG_COMPILE_ONLY | JS_EVAL_FLAG_STRICT;
+  if (cache->enabled) {
+    key_hash = hako_module_cache_key(module_name, module_body, body_len);
+    pe = hako_module_cache_find(cache, key_hash, module_name, module_body,
+                                body_len, strip_flags);
+  }
 
-  func_val =
-      JS_Eval(ctx, module_body, strlen(module_body), module_name, eval_flags);
+  if (pe && *pe) {
+    cache->hits++;
+    func_val = JS_ReadObject(ctx, (*pe)->bytecode, (*pe)->bytecode_len,
+                             JS_READ_OBJ_BYTECODE);
+  } else {
+    if (cache->enabled)
+      cache->misses++;
+    eval_flags =
+        JS_EVAL_TYPE_MODULE | JS_EVAL_FLAG_COMPILE_ONLY | JS_EVAL_FLAG_STRICT;
+    if (!resolve)
+      eval_flags |= JS_EVAL_FLAG_NO_RESOLVE;
+    func_val = JS_Eval(ctx, module_body, body_len, module_name, eval_flags);
+    if (cache->enabled && JS_VALUE_IS_MODULE(func_val))
+      hako_module_cache_put(ctx, cache, key_hash, module_name, module_body,
+                            body_len, strip_flags, func_val);
+  }
 
   if (JS_IsException(func_val))
     goto done;
@@ -254,7 +583,7 @@ static JSModuleDef *hako_load_module(JSContext *ctx, const char *module_name,
   case HAKO_MODULE_SOURCE_STRING:
     source_code = (char *)module_source->data.source_code;
     if (source_code != NULL) {
-      result = hako_compile_module(ctx, module_name, source_code);
+      result = hako_compile_module(ctx, module_name, source_code, TRUE);
     } else {
       JS_ThrowTypeError(ctx, "Invalid source code for module '%s'",
                         module_name);
@@ -309,14 +638,108 @@ done:
 }
 
 
+/* The chunks belong to the runtime and are shared by all its contexts,
+   so they are not charged to the context that happens to grow them. */
+static JSValue *hako_scope_alloc(JSContext *ctx, HakoScopeArena *a) {
+  JSRuntime *rt = JS_GetRuntime(ctx);
+  uint32_t chunk_idx = a->top >> HAKO_SCOPE_CHUNK_BITS;
+  JSValue *chunk;
+
+  if (chunk_idx >= a->chunk_count) {
+    if (a->chunk_count >= a->chunk_size) {
+      uint32_t new_size = max_int(a->chunk_size * 2, 4);
+      JSValue **new_chunks =
+          js_realloc_rt(rt, a->chunks, sizeof(a->chunks[0]) * new_size);
+      if (!new_chunks)
+        goto fail;
+      a->chunks = new_chunks;
+      a->chunk_size = new_size;
+    }
+    chunk = js_malloc_rt(rt, sizeof(JSValue) * HAKO_SCOPE_CHUNK_SIZE);
+    if (!chunk)
+      goto fail;
+    if (a->chunk_count == 0 || chunk < a->lo)
+      a->lo = chunk;
+    if (a->chunk_count == 0 || chunk + HAKO_SCOPE_CHUNK_SIZE > a->hi)
+      a->hi = chunk + HAKO_SCOPE_CHUNK_SIZE;
+    a->chunks[a->chunk_count++] = chunk;
+  }
+  return &a->chunks[chunk_idx][a->top++ & (HAKO_SCOPE_CHUNK_SIZE - 1)];
+
+fail:
+  JS_ThrowOutOfMemory(ctx);
+  return NULL;
+}
+
+/* Heap boxes outside the range of all chunks are rejected without a
+   search. Otherwise the chunk below the bump pointer, which holds the
+   values of the innermost scope, is checked before the others. */
+static JS_BOOL hako_scope_owns(HakoScopeArena *a, const JSValue *ptr) {
+  uint32_t i, cur;
+
+  if (ptr < a->lo || ptr >= a->hi)
+    return FALSE;
+  cur = a->top ? (a->top - 1) >> HAKO_SCOPE_CHUNK_BITS : 0;
+  if (ptr >= a->chunks[cur] && ptr < a->chunks[cur] + HAKO_SCOPE_CHUNK_SIZE)
+    return TRUE;
+  for (i = 0; i < a->chunk_count; i++) {
+    if (ptr >= a->chunks[i] && ptr < a->chunks[i] + HAKO_SCOPE_CHUNK_SIZE)
+      return TRUE;
+  }
+  return FALSE;
+}
+
+static void hako_scope_release(JSRuntime *rt, HakoScopeArena *a,
+                               uint32_t mark) {
+  JSValue *slot;
+
+  while (a->top > mark) {
+    a->top--;
+    slot = &a->chunks[a->top >> HAKO_SCOPE_CHUNK_BITS]
+                     [a->top & (HAKO_SCOPE_CHUNK_SIZE - 1)];
+    JS_FreeValueRT(rt, *slot);
+  }
+}
+
+static void hako_scope_arena_free(JSRuntime *rt, HakoScopeArena *a) {
+  uint32_t i;
+
+  hako_scope_release(rt, a, 0);
+  for (i = 0; i < a->chunk_count; i++)
+    js_free_rt(rt, a->chunks[i]);
+  js_free_rt(rt, a->chunks);
+  js_free_rt(rt, a->marks);
+  memset(a, 0, sizeof(*a));
+}
+
 static JSValue *jsvalue_to_heap(JSContext *ctx, JSValueConst value) {
-  JSValue *result = js_malloc(ctx, sizeof(JSValue));
+  HakoScopeArena *scopes = &hako_runtime(JS_GetRuntime(ctx))->scopes;
+  JSValue *result;
+
+  if (scopes->depth > 0)
+    result = hako_scope_alloc(ctx, scopes);
+  else
+    result = js_malloc(ctx, sizeof(JSValue));
   if (result) {
     *result = value;
   }
   return result;
 }
 
+/* Takes the value out of a box returned by the host and releases the box. */
+static JSValue hako_take_value(JSContext *ctx, JSValue *ptr) {
+  HakoScopeArena *scopes = &hako_runtime(JS_GetRuntime(ctx))->scopes;
+  JSValue result = *ptr;
+
+  if (is_static_constant(ptr))
+    return result;
+  if (hako_scope_owns(scopes, ptr))
+    *ptr = JS_UNDEFINED;
+  else
+    js_free(ctx, ptr);
+  return result;
+}
+
 JSValue *HAKO_Throw(JSContext *ctx, JSValueConst *error) {
   JSValue copy = JS_DupValue(ctx, *error);
   return jsvalue_to_heap(ctx, JS_Throw(ctx, copy));
@@ -452,7 +875,7 @@ HAKO_Status HAKO_InitTypeStripper(JSRuntime* rt) {
   if (!rt) {
     return HAKO_STATUS_ERROR_INVALID_ARGS;
   }
-  if (JS_GetRuntimeOpaque(rt) != NULL) {
+  if (hako_runtime(rt)->type_stripper != NULL) {
     return HAKO_STATUS_SUCCESS;
   }
   
@@ -466,7 +889,7 @@ HAKO_Status HAKO_InitTypeStripper(JSRuntime* rt) {
   if (ctx == NULL) {
     return HAKO_STATUS_ERROR_OUT_OF_MEMORY;
   }
-  JS_SetRuntimeOpaque(rt, ctx);
+  hako_runtime(rt)->type_stripper = ctx;
   return HAKO_STATUS_SUCCESS;
 }
 
@@ -474,10 +897,10 @@ void HAKO_CleanupTypeStripper(JSRuntime* rt) {
   if (!rt) {
     return;
   }
-  ts_strip_ctx_t* ctx = JS_GetRuntimeOpaque(rt);
+  ts_strip_ctx_t* ctx = hako_runtime(rt)->type_stripper;
   if (ctx != NULL) {
     ts_strip_ctx_delete(ctx);
-    JS_SetRuntimeOpaque(rt, NULL);
+    hako_runtime(rt)->type_stripper = NULL;
   }
 }
 
@@ -485,7 +908,7 @@ HAKO_Status HAKO_StripTypes(JSRuntime* rt, const char* typescript_source,
                             char** javascript_out,
                             size_t* javascript_len) {
   ts_strip_result_t result;
-  ts_strip_ctx_t* ctx = JS_GetRuntimeOpaque(rt);
+  ts_strip_ctx_t* ctx = hako_runtime(rt)->type_stripper;
   
   if (ctx == NULL) {
     return HAKO_STATUS_ERROR_INVALID_ARGS;
@@ -515,32 +938,98 @@ JSValueConst *HAKO_GetNull(void) { return &HAKO_Null; }
 JSValueConst *HAKO_GetFalse(void) { return &HAKO_False; }
 JSValueConst *HAKO_GetTrue(void) { return &HAKO_True; }
 
-JSRuntime *HAKO_NewRuntime(void) {
-  JSRuntime *rt = JS_NewRuntime();
+JSRuntime *HAKO_NewRuntime(void) { return HAKO_NewRuntimeWithFlags(0); }
+
+JSRuntime *HAKO_NewRuntimeWithFlags(uint32_t flags) {
+  JSRuntime *rt = (flags & HAKO_RUNTIME_CONTEXT_MEMORY)
+                      ? JS_NewRuntimeWithContextAccounting()
+                      : JS_NewRuntime();
+  HakoRuntime *hrt;
   if (rt == NULL)
     return NULL;
 
+  hrt = js_mallocz_rt(rt, sizeof(HakoRuntime));
+  if (hrt == NULL) {
+    JS_FreeRuntime(rt);
+    return NULL;
+  }
+  JS_SetRuntimeOpaque(rt, hrt);
   JS_SetRuntimeInfo(rt, "HakoJS");
+  JS_SetContextFinalizer(rt, hako_context_detach);
   return rt;
 }
 
-void HAKO_FreeRuntime(JSRuntime *rt) { JS_FreeRuntime(rt); }
+void HAKO_FreeRuntime(JSRuntime *rt) {
+  HakoRuntime *hrt = hako_runtime(rt);
+
+  if (hrt) {
+    hako_scope_arena_free(rt, &hrt->scopes);
+    js_free_rt(rt, hrt->json_scratch);
+    hako_module_cache_clear(rt, &hrt->module_cache);
+    if (hrt->type_stripper)
+      ts_strip_ctx_delete(hrt->type_stripper);
+    js_free_rt(rt, hrt);
+    JS_SetRuntimeOpaque(rt, NULL);
+  }
+  JS_FreeRuntime(rt);
+}
 
 void HAKO_SetStripInfo(JSRuntime *rt, int32_t flags) { JS_SetStripInfo(rt, flags); }
 
 int32_t HAKO_GetStripInfo(JSRuntime *rt) { return JS_GetStripInfo(rt); }
 
+static void hako_handle_table_free(JSContext *ctx, HakoHandleTable *t);
+
+static int32_t hako_context_attach(JSContext *ctx) {
+  HakoContext *hctx = js_mallocz(ctx, sizeof(HakoContext));
+  if (!hctx)
+    return -1;
+  JS_SetContextOpaque(ctx, hctx);
+  return 0;
+}
+
+/* Releases the values the context holds on behalf of the host. They may
+   reference the context itself, so this is done when the host frees the
+   context instead of waiting for its last reference to go away. */
+static void hako_context_release(JSContext *ctx) {
+  HakoContext *hctx = hako_context(ctx);
+  if (!hctx)
+    return;
+  JS_FreeContextSnapshot(ctx, hctx->snapshot);
+  hctx->snapshot = NULL;
+  hako_module_loader_free(ctx, &hctx->loader);
+  hako_handle_table_free(ctx, &hctx->handles);
+}
+
+/* Context finalizer: the HakoContext lives as long as the JSContext. */
+static void hako_context_detach(JSContext *ctx) {
+  HakoContext *hctx = hako_context(ctx);
+  if (!hctx)
+    return;
+  hako_context_release(ctx);
+  js_free(ctx, hctx);
+  JS_SetContextOpaque(ctx, NULL);
+}
+
 JSContext *HAKO_NewContext(JSRuntime *rt, HAKO_Intrinsic intrinsics) {
   JSContext *ctx = NULL;
 
   if (intrinsics == 0) {
     ctx = JS_NewContext(rt);
+    if (ctx && hako_context_attach(ctx) < 0) {
+      JS_FreeContext(ctx);
+      return NULL;
+    }
     return ctx;
   }
 
   ctx = JS_NewContextRaw(rt);
   if (ctx == NULL)
     return NULL;
+  if (hako_context_attach(ctx) < 0) {
+    JS_FreeContext(ctx);
+    return NULL;
+  }
 
   if (intrinsics & HAKO_Intrinsic_BaseObjects) {
     JS_AddIntrinsicBaseObjects(ctx);
@@ -585,24 +1074,29 @@ JSContext *HAKO_NewContext(JSRuntime *rt, HAKO_Intrinsic intrinsics) {
 }
 
 void HAKO_SetContextData(JSContext *ctx, void *data) {
-  JS_SetContextOpaque(ctx, data);
+  hako_context(ctx)->host_data = data;
+}
+
+void *HAKO_GetContextData(JSContext *ctx) {
+  return hako_context(ctx)->host_data;
 }
 
-void *HAKO_GetContextData(JSContext *ctx) { return JS_GetContextOpaque(ctx); }
+void HAKO_FreeContext(JSContext *ctx) {
+  /* other references (e.g. functions of this realm held by another
+     context) may keep the context alive; its HakoContext is freed by
+     hako_context_detach once the last one is gone */
+  hako_context_release(ctx);
+  JS_FreeContext(ctx);
+}
 
-void HAKO_FreeContext(JSContext *ctx) { JS_FreeContext(ctx); }
+void HAKO_ReleaseContext(JSContext *ctx) { JS_FreeContext(ctx); }
 
 JSValue *HAKO_DupValuePointer(JSContext *ctx, JSValueConst *val) {
   return jsvalue_to_heap(ctx, JS_DupValue(ctx, *val));
 }
 
 void HAKO_FreeValuePointer(JSContext *ctx, JSValue *value) {
-  if (is_static_constant(value)) {
-    fprintf(stderr, "Attempted to free static constant\n");
-    __builtin_unreachable();
-  }
-  JS_FreeValue(ctx, *value);
-  js_free(ctx, value);
+  HAKO_FreeValuePointerRuntime(JS_GetRuntime(ctx), value);
 }
 
 void HAKO_FreeValuePointerRuntime(JSRuntime *rt, JSValue *value) {
@@ -611,7 +1105,54 @@ void HAKO_FreeValuePointerRuntime(JSRuntime *rt, JSValue *value) {
     __builtin_unreachable();
   }
   JS_FreeValueRT(rt, *value);
-  js_free_rt(rt, value);
+  /* scoped values are reclaimed when their scope closes */
+  if (hako_scope_owns(&hako_runtime(rt)->scopes, value))
+    *value = JS_UNDEFINED;
+  else
+    js_free_rt(rt, value);
+}
+
+int32_t HAKO_ScopeOpen(JSRuntime *rt) {
+  HakoScopeArena *a = &hako_runtime(rt)->scopes;
+
+  if (a->depth >= a->marks_size) {
+    uint32_t new_size = max_int(a->marks_size * 2, 8);
+    uint32_t *new_marks =
+        js_realloc_rt(rt, a->marks, sizeof(a->marks[0]) * new_size);
+    if (!new_marks)
+      return -1;
+    a->marks = new_marks;
+    a->marks_size = new_size;
+  }
+  a->marks[a->depth++] = a->top;
+  return a->depth;
+}
+
+int32_t HAKO_ScopeClose(JSRuntime *rt) {
+  HakoScopeArena *a = &hako_runtime(rt)->scopes;
+
+  if (a->depth == 0)
+    return -1;
+  hako_scope_release(rt, a, a->marks[--a->depth]);
+  return a->depth;
+}
+
+int32_t HAKO_ScopeDepth(JSRuntime *rt) {
+  return hako_runtime(rt)->scopes.depth;
+}
+
+JSValue *HAKO_ScopeEscape(JSContext *ctx, JSValue *value) {
+  HakoScopeArena *a = &hako_runtime(JS_GetRuntime(ctx))->scopes;
+  JSValue *result;
+
+  if (!hako_scope_owns(a, value))
+    return value;
+  result = js_malloc(ctx, sizeof(JSValue));
+  if (!result)
+    return NULL;
+  *result = *value;
+  *value = JS_UNDEFINED;
+  return result;
 }
 
 void *HAKO_Malloc(JSContext *ctx, size_t size) {
@@ -762,6 +1303,7 @@ JSValue *HAKO_Eval(JSContext *ctx, const char *js_code, size_t js_code_length,
   const char *code_to_eval = js_code;
   size_t code_len = js_code_length;
   int32_t should_strip = 0;
+  int64_t fuel_start = JS_GetFuelUsed(ctx);
 
   // Check if we should strip TypeScript types
   should_strip =
@@ -786,6 +1328,7 @@ JSValue *HAKO_Eval(JSContext *ctx, const char *js_code, size_t js_code_length,
       if (stripped_js != NULL) {
          js_free_rt(JS_GetRuntime(ctx), stripped_js);
       }
+      hako_fuel_record(ctx, fuel_start);
       return jsvalue_to_heap(
           ctx,
           JS_ThrowSyntaxError(ctx, "Failed to strip TypeScript types: %s",
@@ -909,6 +1452,7 @@ done:
   if (then_atom != JS_ATOM_NULL)
     JS_FreeAtom(ctx, then_atom);
 
+  hako_fuel_record(ctx, fuel_start);
   return result;
 }
 
@@ -1009,6 +1553,73 @@ int32_t HAKO_ExecutePendingJob(JSRuntime *rt, int32_t maxJobsToExecute,
   return executed;
 }
 
+static HakoJobContextStats *hako_drain_stats(HakoJobDrain *drain,
+                                             JSContext *ctx) {
+  int32_t i;
+
+  /* jobs of one context tend to come in runs: search from the end */
+  for (i = drain->contexts_count - 1; i >= 0; i--) {
+    if (drain->contexts[i].ctx == ctx)
+      return &drain->contexts[i];
+  }
+  if (drain->contexts_count == drain->contexts_capacity)
+    return NULL;
+  drain->contexts[drain->contexts_count] =
+      (HakoJobContextStats){ctx, 0, 0};
+  return &drain->contexts[drain->contexts_count++];
+}
+
+int32_t HAKO_DrainJobs(JSRuntime *rt, HakoJobDrain *drain) {
+  HakoJobContextStats *stats;
+  JSContext *ctx;
+  JSValue exception;
+  int64_t fuel_start;
+  int status;
+
+  drain->contexts_count = 0;
+  drain->executed = 0;
+  drain->failed = 0;
+  drain->fuel_used = 0;
+  drain->error_ctx = NULL;
+  drain->error = NULL;
+  if (!drain->contexts)
+    drain->contexts_capacity = 0;
+
+  while ((ctx = JS_GetPendingJobContext(rt)) != NULL) {
+    if (drain->executed == drain->max_jobs && drain->max_jobs > 0)
+      break;
+    if (drain->max_fuel > 0 && drain->fuel_used >= drain->max_fuel)
+      break;
+    if (drain->deadline_ns && hako_monotonic_ns() >= drain->deadline_ns)
+      break;
+
+    /* keep the realm alive to read its exception and fuel */
+    JS_DupContext(ctx);
+    fuel_start = JS_GetFuelUsed(ctx);
+    status = JS_ExecutePendingJob(rt, NULL);
+    drain->fuel_used += JS_GetFuelUsed(ctx) - fuel_start;
+    drain->executed++;
+    stats = hako_drain_stats(drain, ctx);
+    if (stats)
+      stats->executed++;
+    if (status < 0) {
+      drain->failed++;
+      if (stats)
+        stats->failed++;
+      exception = JS_GetException(ctx);
+      if (!drain->error_ctx) {
+        /* the reference is handed to the host */
+        drain->error_ctx = ctx;
+        drain->error = jsvalue_to_heap(ctx, exception);
+        continue;
+      }
+      JS_FreeValue(ctx, exception);
+    }
+    JS_FreeContext(ctx);
+  }
+  return JS_IsJobPending(rt);
+}
+
 JSValue *HAKO_GetProp(JSContext *ctx, JSValueConst *this_val,
                       JSValueConst *prop_name) {
   JSAtom prop_atom;
@@ -1054,27 +1665,20 @@ JS_BOOL HAKO_SetProp(JSContext *ctx, JSValueConst *this_val,
   return result;
 }
 
-JS_BOOL HAKO_DefineProp(JSContext *ctx, JSValueConst *this_val,
-                        JSValueConst *prop_name, JSValueConst *prop_value,
-                        JSValueConst *get, JSValueConst *set,
-                        JS_BOOL configurable, JS_BOOL enumerable,
-                        JS_BOOL has_value, JS_BOOL has_writable,
-                        JS_BOOL writable) {
-  JSAtom prop_atom;
+/* Builds JS_DefineProperty flags from a host descriptor, or returns -1
+   with an exception pending if the descriptor is invalid. */
+static int32_t hako_define_prop_flags(JSContext *ctx, JSValueConst *get,
+                                      JSValueConst *set, JS_BOOL configurable,
+                                      JS_BOOL enumerable, JS_BOOL has_value,
+                                      JS_BOOL has_writable, JS_BOOL writable) {
   int32_t flags = 0;
   int32_t has_get, has_set, is_accessor;
-  int32_t result;
-
-  prop_atom = JS_ValueToAtom(ctx, *prop_name);
-  if (prop_atom == JS_ATOM_NULL)
-    return -1;
 
   has_get = !JS_IsUndefined(*get);
   has_set = !JS_IsUndefined(*set);
   is_accessor = (has_get || has_set);
 
   if (is_accessor && (has_value || has_writable)) {
-    JS_FreeAtom(ctx, prop_atom);
     JS_ThrowTypeError(ctx, "accessor descriptor cannot include value/writable");
     return -1;
   }
@@ -1100,6 +1704,29 @@ JS_BOOL HAKO_DefineProp(JSContext *ctx, JSValueConst *this_val,
       flags |= JS_PROP_WRITABLE;
     }
   }
+  return flags;
+}
+
+JS_BOOL HAKO_DefineProp(JSContext *ctx, JSValueConst *this_val,
+                        JSValueConst *prop_name, JSValueConst *prop_value,
+                        JSValueConst *get, JSValueConst *set,
+                        JS_BOOL configurable, JS_BOOL enumerable,
+                        JS_BOOL has_value, JS_BOOL has_writable,
+                        JS_BOOL writable) {
+  JSAtom prop_atom;
+  int32_t flags;
+  int32_t result;
+
+  prop_atom = JS_ValueToAtom(ctx, *prop_name);
+  if (prop_atom == JS_ATOM_NULL)
+    return -1;
+
+  flags = hako_define_prop_flags(ctx, get, set, configurable, enumerable,
+                                 has_value, has_writable, writable);
+  if (flags < 0) {
+    JS_FreeAtom(ctx, prop_atom);
+    return -1;
+  }
 
   result = JS_DefineProperty(ctx, *this_val, prop_atom, *prop_value, *get, *set,
                              flags);
@@ -1218,13 +1845,17 @@ done:
 JSValue *HAKO_Call(JSContext *ctx, JSValueConst *func_obj,
                    JSValueConst *this_obj, int32_t argc, JSValueConst **argv_ptrs) {
   JSValueConst argv[argc];
+  int64_t fuel_start = JS_GetFuelUsed(ctx);
+  JSValue result;
   int32_t i;
 
   for (i = 0; i < argc; i++) {
     argv[i] = *(argv_ptrs[i]);
   }
 
-  return jsvalue_to_heap(ctx, JS_Call(ctx, *func_obj, *this_obj, argc, argv));
+  result = JS_Call(ctx, *func_obj, *this_obj, argc, argv);
+  hako_fuel_record(ctx, fuel_start);
+  return jsvalue_to_heap(ctx, result);
 }
 
 JSValue *HAKO_GetLastError(JSContext *ctx, JSValue *maybe_exception) {
@@ -1518,19 +2149,13 @@ JS_BOOL HAKO_BuildIsDebug(void) {
 JSValue hako_call_function(JSContext *ctx, JSValueConst this_val, int32_t argc,
                            JSValueConst *argv, int32_t magic) {
   JSValue *result_ptr = NULL;
-  JSValue result;
 
   result_ptr = host_call_function(ctx, &this_val, argc, argv, magic);
 
   if (result_ptr == NULL)
     return JS_UNDEFINED;
 
-  if (is_static_constant(result_ptr))
-    return *result_ptr;
-
-  result = *result_ptr;
-  js_free(ctx, result_ptr);
-  return result;
+  return hako_take_value(ctx, result_ptr);
 }
 
 JSValue *HAKO_NewFunction(JSContext *ctx, int32_t func_id, const char *name) {
@@ -1551,6 +2176,34 @@ void HAKO_RuntimeDisableInterruptHandler(JSRuntime *rt) {
   JS_SetInterruptHandler(rt, NULL, NULL);
 }
 
+static int hako_interrupt_state_handler(JSRuntime *rt, JSContext *ctx, void *opaque) {
+  HakoRuntime *hrt = opaque;
+  /* the host may write the state between two polls */
+  volatile HakoInterruptState *state = &hrt->interrupt;
+  uint64_t deadline = state->deadline_ns;
+
+  if (!state->requested && (deadline == 0 || hako_monotonic_ns() < deadline))
+    return 0;
+  if (hrt->interrupt_call_host)
+    return host_interrupt_handler(rt, ctx, hrt->interrupt_opaque) != 0;
+  return 1;
+}
+
+HakoInterruptState *HAKO_RuntimeEnableInterruptState(JSRuntime *rt, int32_t call_host,
+                                                     void *opaque) {
+  HakoRuntime *hrt = hako_runtime(rt);
+
+  memset(&hrt->interrupt, 0, sizeof(hrt->interrupt));
+  hrt->interrupt_call_host = call_host != 0;
+  hrt->interrupt_opaque = opaque;
+  JS_SetInterruptHandler(rt, hako_interrupt_state_handler, hrt);
+  return &hrt->interrupt;
+}
+
+void HAKO_RuntimeSetInterruptInterval(JSRuntime *rt, int32_t ticks) {
+  JS_SetInterruptInterval(rt, ticks);
+}
+
 static int32_t hako_module_check_attributes(JSContext *ctx, void *opaque,
                                         JSValueConst attributes) {
   JSPropertyEnum *tab = NULL;
@@ -2016,19 +2669,13 @@ static JSValue hako_class_constructor_wrapper(JSContext *ctx,
                                               JSValueConst *argv, int32_t magic) {
   JSClassID class_id = (JSClassID)magic;
   JSValue *result = NULL;
-  JSValue ret;
 
   result = host_class_constructor(ctx, &new_target, argc, argv, class_id);
 
   if (!result)
     return JS_EXCEPTION;
 
-  if (is_static_constant(result))
-    return *result;
-
-  ret = *result;
-  js_free(ctx, result);
-  return ret;
+  return hako_take_value(ctx, result);
 }
 
 static void hako_class_finalizer_wrapper(JSRuntime *rt, JSValue val) {
@@ -2184,4 +2831,2047 @@ void HAKO_SetPromiseRejectionHandler(JSRuntime *rt, void *opaque) {
 
 void HAKO_ClearPromiseRejectionHandler(JSRuntime *rt) {
   JS_SetHostPromiseRejectionTracker(rt, NULL, NULL);
-}
\ No newline at end of file
+}
+/* Handle table */
+
+static void hako_handle_table_free(JSContext *ctx, HakoHandleTable *t) {
+  uint32_t i;
+
+  for (i = HAKO_HANDLE_FIRST_DYNAMIC; i < t->used; i++) {
+    if (t->slots[i].gen & 1)
+      JS_FreeValue(ctx, t->slots[i].value);
+  }
+  js_free(ctx, t->slots);
+  memset(t, 0, sizeof(*t));
+}
+
+static JSValue hako_handle_constants[HAKO_HANDLE_FIRST_DYNAMIC] = {
+    [HAKO_HANDLE_INVALID] = JS_UNDEFINED,
+    [HAKO_HANDLE_UNDEFINED] = JS_UNDEFINED,
+    [HAKO_HANDLE_NULL] = JS_NULL,
+    [HAKO_HANDLE_FALSE] = JS_FALSE,
+    [HAKO_HANDLE_TRUE] = JS_TRUE,
+};
+
+static int32_t hako_handle_table_init(JSContext *ctx, HakoHandleTable *t) {
+  t->slots = js_mallocz(ctx, sizeof(HakoHandleSlot) * HAKO_HANDLE_INITIAL_SIZE);
+  if (!t->slots)
+    return -1;
+  t->size = HAKO_HANDLE_INITIAL_SIZE;
+  t->used = HAKO_HANDLE_FIRST_DYNAMIC;
+  return 0;
+}
+
+/* Slot generations are odd while the slot is live and even once it has
+   been released, so a single compare validates a handle.
+   HAKO_HANDLE_INVALID and HAKO_HANDLE_EXCEPTION are result codes only and
+   never resolve to a value. */
+static inline JSValue *hako_handle_ref(HakoHandleTable *t, HakoHandle h) {
+  uint32_t idx = h & HAKO_HANDLE_INDEX_MASK;
+  uint32_t gen = h >> HAKO_HANDLE_INDEX_BITS;
+  HakoHandleSlot *slot;
+
+  if (idx < HAKO_HANDLE_FIRST_DYNAMIC)
+    return (idx != HAKO_HANDLE_INVALID && idx != HAKO_HANDLE_EXCEPTION &&
+            gen == 0)
+               ? &hako_handle_constants[idx]
+               : NULL;
+  if (idx >= t->used)
+    return NULL;
+  slot = &t->slots[idx];
+  if ((slot->gen & HAKO_HANDLE_GEN_MASK) != gen || !(slot->gen & 1))
+    return NULL;
+  return &slot->value;
+}
+
+/* Takes ownership of 'val'. Exceptions map to HAKO_HANDLE_EXCEPTION and
+   never occupy a slot. */
+static HakoHandle hako_handle_new(JSContext *ctx, JSValue val) {
+  HakoHandleTable *t = &hako_context(ctx)->handles;
+  HakoHandleSlot *slot;
+  uint32_t idx, new_size;
+
+  if (JS_IsException(val))
+    return HAKO_HANDLE_EXCEPTION;
+
+  if (unlikely(!t->slots) && hako_handle_table_init(ctx, t) < 0)
+    goto fail;
+
+  if (t->free_head) {
+    idx = t->free_head;
+    t->free_head = t->slots[idx].next_free;
+  } else {
+    if (t->used >= t->size) {
+      HakoHandleSlot *new_slots;
+      new_size = t->size * 2;
+      if (new_size > HAKO_HANDLE_INDEX_MASK + 1) {
+        JS_ThrowRangeError(ctx, "too many live handles");
+        goto fail;
+      }
+      new_slots = js_realloc(ctx, t->slots, sizeof(HakoHandleSlot) * new_size);
+      if (!new_slots)
+        goto fail;
+      t->slots = new_slots;
+      t->size = new_size;
+    }
+    idx = t->used++;
+    t->slots[idx].gen = 0;
+  }
+
+  slot = &t->slots[idx];
+  slot->gen = (slot->gen + 1) & HAKO_HANDLE_GEN_MASK;
+  slot->value = val;
+  slot->next_free = 0;
+  t->live++;
+  return idx | (slot->gen << HAKO_HANDLE_INDEX_BITS);
+
+fail:
+  JS_FreeValue(ctx, val);
+  return HAKO_HANDLE_EXCEPTION;
+}
+
+static void hako_handle_release(JSContext *ctx, HakoHandleTable *t,
+                                HakoHandle h) {
+  uint32_t idx = h & HAKO_HANDLE_INDEX_MASK;
+  HakoHandleSlot *slot;
+
+  if (idx < HAKO_HANDLE_FIRST_DYNAMIC || !hako_handle_ref(t, h))
+    return;
+  slot = &t->slots[idx];
+  JS_FreeValue(ctx, slot->value);
+  slot->value = JS_UNDEFINED;
+  slot->gen = (slot->gen + 1) & HAKO_HANDLE_GEN_MASK;
+  slot->next_free = t->free_head;
+  t->free_head = idx;
+  t->live--;
+}
+
+/* Resolves a handle argument, throwing on stale or unknown handles. */
+#define HAKO_HANDLE_ARG(ctx, var, h)                                           \
+  JSValue *var = hako_handle_ref(&hako_context(ctx)->handles, (h));            \
+  if (unlikely(!var)) {                                                        \
+    JS_ThrowReferenceError((ctx), "invalid handle 0x%x", (unsigned)(h));       \
+    return HAKO_HANDLE_EXCEPTION;                                              \
+  }
+
+HakoHandle HAKO_HandleNew(JSContext *ctx, JSValueConst *val) {
+  return hako_handle_new(ctx, JS_DupValue(ctx, *val));
+}
+
+JSValue *HAKO_HandleToPointer(JSContext *ctx, HakoHandle h) {
+  JSValue *val = hako_handle_ref(&hako_context(ctx)->handles, h);
+  if (!val)
+    return jsvalue_to_heap(
+        ctx, JS_ThrowReferenceError(ctx, "invalid handle 0x%x", (unsigned)h));
+  return jsvalue_to_heap(ctx, JS_DupValue(ctx, *val));
+}
+
+HakoHandle HAKO_HandleDup(JSContext *ctx, HakoHandle h) {
+  HAKO_HANDLE_ARG(ctx, val, h);
+  if (h < HAKO_HANDLE_FIRST_DYNAMIC)
+    return h;
+  return hako_handle_new(ctx, JS_DupValue(ctx, *val));
+}
+
+void HAKO_HandleFree(JSContext *ctx, HakoHandle h) {
+  hako_handle_release(ctx, &hako_context(ctx)->handles, h);
+}
+
+void HAKO_HandleFreeMany(JSContext *ctx, const HakoHandle *handles,
+                         uint32_t count) {
+  HakoHandleTable *t = &hako_context(ctx)->handles;
+  uint32_t i;
+
+  for (i = 0; i < count; i++)
+    hako_handle_release(ctx, t, handles[i]);
+}
+
+void HAKO_HandleFreeAll(JSContext *ctx) {
+  HakoHandleTable *t = &hako_context(ctx)->handles;
+  HakoHandleSlot *slot;
+  uint32_t i;
+
+  if (!t->slots)
+    return;
+  t->free_head = 0;
+  /* rebuild the free list so that low slots are reused first */
+  for (i = t->used; i-- > HAKO_HANDLE_FIRST_DYNAMIC;) {
+    slot = &t->slots[i];
+    if (slot->gen & 1) {
+      JS_FreeValue(ctx, slot->value);
+      slot->value = JS_UNDEFINED;
+      slot->gen = (slot->gen + 1) & HAKO_HANDLE_GEN_MASK;
+    }
+    slot->next_free = t->free_head;
+    t->free_head = i;
+  }
+  t->live = 0;
+}
+
+uint32_t HAKO_HandleCount(JSContext *ctx) {
+  return hako_context(ctx)->handles.live;
+}
+
+HakoHandle HAKO_HandleGetException(JSContext *ctx) {
+  JSValue exception = JS_GetException(ctx);
+  if (JS_IsNull(exception))
+    return HAKO_HANDLE_NULL;
+  return hako_handle_new(ctx, exception);
+}
+
+HakoHandle HAKO_HandleGetGlobalObject(JSContext *ctx) {
+  return hako_handle_new(ctx, JS_GetGlobalObject(ctx));
+}
+
+HakoHandle HAKO_HandleNewObject(JSContext *ctx) {
+  return hako_handle_new(ctx, JS_NewObject(ctx));
+}
+
+HakoHandle HAKO_HandleNewArray(JSContext *ctx) {
+  return hako_handle_new(ctx, JS_NewArray(ctx));
+}
+
+HakoHandle HAKO_HandleNewFloat64(JSContext *ctx, double num) {
+  return hako_handle_new(ctx, JS_NewFloat64(ctx, num));
+}
+
+HakoHandle HAKO_HandleNewString(JSContext *ctx, const char *str) {
+  return hako_handle_new(ctx, JS_NewString(ctx, str));
+}
+
+double HAKO_HandleGetFloat64(JSContext *ctx, HakoHandle h) {
+  JSValue *val = hako_handle_ref(&hako_context(ctx)->handles, h);
+  double result = NAN;
+
+  if (val)
+    JS_ToFloat64(ctx, &result, *val);
+  return result;
+}
+
+const char *HAKO_HandleToCString(JSContext *ctx, HakoHandle h) {
+  JSValue *val = hako_handle_ref(&hako_context(ctx)->handles, h);
+  if (!val)
+    return NULL;
+  return JS_ToCString(ctx, *val);
+}
+
+HAKOTypeOf HAKO_HandleTypeOf(JSContext *ctx, HakoHandle h) {
+  JSValue *val = hako_handle_ref(&hako_context(ctx)->handles, h);
+  if (!val)
+    return HAKO_TYPE_UNDEFINED;
+  return HAKO_TypeOf(ctx, val);
+}
+
+HakoHandle HAKO_HandleGetProp(JSContext *ctx, HakoHandle this_h,
+                              HakoHandle prop_h) {
+  JSAtom prop_atom;
+  JSValue prop_val;
+  HAKO_HANDLE_ARG(ctx, this_val, this_h);
+  HAKO_HANDLE_ARG(ctx, prop_name, prop_h);
+
+  prop_atom = JS_ValueToAtom(ctx, *prop_name);
+  if (prop_atom == JS_ATOM_NULL)
+    return HAKO_HANDLE_EXCEPTION;
+  prop_val = JS_GetProperty(ctx, *this_val, prop_atom);
+  JS_FreeAtom(ctx, prop_atom);
+  return hako_handle_new(ctx, prop_val);
+}
+
+HakoHandle HAKO_HandleGetPropNumber(JSContext *ctx, HakoHandle this_h,
+                                    int32_t prop_index) {
+  HAKO_HANDLE_ARG(ctx, this_val, this_h);
+  return hako_handle_new(
+      ctx, JS_GetPropertyUint32(ctx, *this_val, (uint32_t)prop_index));
+}
+
+JS_BOOL HAKO_HandleSetProp(JSContext *ctx, HakoHandle this_h,
+                           HakoHandle prop_h, HakoHandle val_h) {
+  HakoHandleTable *t = &hako_context(ctx)->handles;
+  JSValue *this_val = hako_handle_ref(t, this_h);
+  JSValue *prop_name = hako_handle_ref(t, prop_h);
+  JSValue *prop_val = hako_handle_ref(t, val_h);
+  JSAtom prop_atom;
+  int32_t result;
+
+  if (!this_val || !prop_name || !prop_val) {
+    JS_ThrowReferenceError(ctx, "invalid handle 0x%x",
+                           (unsigned)(!this_val   ? this_h
+                                      : !prop_name ? prop_h
+                                                   : val_h));
+    return -1;
+  }
+
+  prop_atom = JS_ValueToAtom(ctx, *prop_name);
+  if (prop_atom == JS_ATOM_NULL)
+    return -1;
+  result =
+      JS_SetProperty(ctx, *this_val, prop_atom, JS_DupValue(ctx, *prop_val));
+  JS_FreeAtom(ctx, prop_atom);
+  return result;
+}
+
+static JSValue hako_handle_call(JSContext *ctx, HakoHandle func_h,
+                                HakoHandle this_h, int32_t argc,
+                                const HakoHandle *argv_handles) {
+  HakoHandleTable *t = &hako_context(ctx)->handles;
+  JSValueConst argv[argc > 0 ? argc : 1];
+  JSValue *func_obj, *this_obj, *arg;
+  int64_t fuel_start = JS_GetFuelUsed(ctx);
+  JSValue result;
+  HakoHandle bad_h;
+  int32_t i;
+
+  func_obj = hako_handle_ref(t, func_h);
+  if (!func_obj) {
+    bad_h = func_h;
+    goto invalid;
+  }
+  this_obj = hako_handle_ref(t, this_h);
+  if (!this_obj) {
+    bad_h = this_h;
+    goto invalid;
+  }
+
+  for (i = 0; i < argc; i++) {
+    arg = hako_handle_ref(t, argv_handles[i]);
+    if (!arg) {
+      bad_h = argv_handles[i];
+      goto invalid;
+    }
+    argv[i] = *arg;
+  }
+
+  result = JS_Call(ctx, *func_obj, *this_obj, argc, argv);
+  hako_fuel_record(ctx, fuel_start);
+  return result;
+
+invalid:
+  hako_fuel_record(ctx, fuel_start);
+  return JS_ThrowReferenceError(ctx, "invalid handle 0x%x", (unsigned)bad_h);
+}
+
+HakoHandle HAKO_HandleCall(JSContext *ctx, HakoHandle func_h,
+                           HakoHandle this_h, int32_t argc,
+                           const HakoHandle *argv_handles) {
+  return hako_handle_new(
+      ctx, hako_handle_call(ctx, func_h, this_h, argc, argv_handles));
+}
+
+/* Packed value slots */
+
+/* Describes '*val' in 'slot' without taking a reference. Strings get a
+   view of their characters, which may flatten a rope in place. */
+static void hako_slot_describe(JSContext *ctx, JSValue *val,
+                               HakoValueSlot *slot) {
+  JS_BOOL is_wide;
+
+  slot->handle = HAKO_HANDLE_INVALID;
+  slot->u.f64 = 0;
+
+  switch (JS_VALUE_GET_NORM_TAG(*val)) {
+  case JS_TAG_UNDEFINED:
+    slot->tag = HAKO_VALUE_UNDEFINED;
+    break;
+  case JS_TAG_NULL:
+    slot->tag = HAKO_VALUE_NULL;
+    break;
+  case JS_TAG_BOOL:
+    slot->tag = HAKO_VALUE_BOOL;
+    slot->u.i32 = JS_VALUE_GET_BOOL(*val);
+    break;
+  case JS_TAG_INT:
+    slot->tag = HAKO_VALUE_INT32;
+    slot->u.i32 = JS_VALUE_GET_INT(*val);
+    break;
+  case JS_TAG_FLOAT64:
+    slot->tag = HAKO_VALUE_FLOAT64;
+    slot->u.f64 = JS_VALUE_GET_FLOAT64(*val);
+    break;
+  case JS_TAG_EXCEPTION:
+    slot->tag = HAKO_VALUE_EXCEPTION;
+    break;
+  case JS_TAG_STRING:
+  case JS_TAG_STRING_ROPE:
+    slot->tag = HAKO_VALUE_STRING;
+    slot->u.str.ptr =
+        JS_GetStringView(ctx, val, &slot->u.str.len, &is_wide);
+    if (!slot->u.str.ptr) {
+      /* flattening a rope failed: the exception is pending */
+      slot->tag = HAKO_VALUE_EXCEPTION;
+      slot->u.f64 = 0;
+    } else if (is_wide) {
+      slot->u.str.len |= HAKO_STRING_WIDE;
+    }
+    break;
+  case JS_TAG_SYMBOL:
+    slot->tag = HAKO_VALUE_SYMBOL;
+    break;
+  case JS_TAG_BIG_INT:
+  case JS_TAG_SHORT_BIG_INT:
+    slot->tag = HAKO_VALUE_BIGINT;
+    break;
+  default:
+    slot->tag =
+        JS_IsFunction(ctx, *val) ? HAKO_VALUE_FUNCTION : HAKO_VALUE_OBJECT;
+    break;
+  }
+}
+
+static inline JS_BOOL hako_tag_is_reference(int32_t tag) {
+  return tag >= HAKO_VALUE_STRING && tag <= HAKO_VALUE_FUNCTION;
+}
+
+/* Stores 'val' into 'slot', taking ownership. Reference types are moved
+   into the handle table. */
+static void hako_slot_encode(JSContext *ctx, JSValue val,
+                             HakoValueSlot *slot) {
+  HakoHandle h;
+
+  hako_slot_describe(ctx, &val, slot);
+  if (!hako_tag_is_reference(slot->tag)) {
+    /* only a string whose view failed holds a reference here */
+    JS_FreeValue(ctx, val);
+    return;
+  }
+
+  h = hako_handle_new(ctx, val);
+  if (h == HAKO_HANDLE_EXCEPTION) {
+    slot->tag = HAKO_VALUE_EXCEPTION;
+    slot->u.f64 = 0;
+    return;
+  }
+  slot->handle = h;
+}
+
+/* Returns a new reference to the value described by 'slot', or
+   JS_EXCEPTION if it names an invalid handle. */
+static JSValue hako_slot_decode(JSContext *ctx, const HakoValueSlot *slot) {
+  JSValue *ref;
+
+  switch (slot->tag) {
+  case HAKO_VALUE_UNDEFINED:
+    return JS_UNDEFINED;
+  case HAKO_VALUE_NULL:
+    return JS_NULL;
+  case HAKO_VALUE_BOOL:
+    return JS_NewBool(ctx, slot->u.i32);
+  case HAKO_VALUE_INT32:
+    return JS_NewInt32(ctx, slot->u.i32);
+  case HAKO_VALUE_FLOAT64:
+    return JS_NewFloat64(ctx, slot->u.f64);
+  default:
+    ref = hako_handle_ref(&hako_context(ctx)->handles, slot->handle);
+    if (!ref)
+      return JS_ThrowReferenceError(ctx, "invalid handle 0x%x",
+                                    (unsigned)slot->handle);
+    return JS_DupValue(ctx, *ref);
+  }
+}
+
+/* Resolves the i-th key of a batch: pre-interned atoms are borrowed,
+   UTF-8 keys are interned and must be freed by the caller. */
+static inline JSAtom hako_batch_atom(JSContext *ctx, const HakoPropKey *keys,
+                                     const JSAtom *atoms, uint32_t i) {
+  if (atoms)
+    return JS_DupAtom(ctx, atoms[i]);
+  return JS_NewAtomLen(ctx, keys[i].name, keys[i].len);
+}
+
+static int32_t hako_get_props(JSContext *ctx, HakoHandle this_h,
+                              const HakoPropKey *keys, const JSAtom *atoms,
+                              uint32_t count, HakoValueSlot *out_slots) {
+  JSValue *this_val = hako_handle_ref(&hako_context(ctx)->handles, this_h);
+  JSValue obj;
+  JSAtom atom;
+  uint32_t i;
+
+  if (!this_val) {
+    JS_ThrowReferenceError(ctx, "invalid handle 0x%x", (unsigned)this_h);
+    return -1;
+  }
+  /* the table may grow while slots are filled and getters may release the
+     handle: keep our own reference to the object */
+  obj = JS_DupValue(ctx, *this_val);
+
+  for (i = 0; i < count; i++) {
+    atom = hako_batch_atom(ctx, keys, atoms, i);
+    if (atom == JS_ATOM_NULL) {
+      hako_slot_encode(ctx, JS_EXCEPTION, &out_slots[i]);
+      goto fail;
+    }
+    hako_slot_encode(ctx, JS_GetProperty(ctx, obj, atom), &out_slots[i]);
+    JS_FreeAtom(ctx, atom);
+    if (out_slots[i].tag == HAKO_VALUE_EXCEPTION)
+      goto fail;
+  }
+  JS_FreeValue(ctx, obj);
+  return count;
+
+fail:
+  JS_FreeValue(ctx, obj);
+  return -1;
+}
+
+static int32_t hako_set_props(JSContext *ctx, HakoHandle this_h,
+                              const HakoPropKey *keys, const JSAtom *atoms,
+                              uint32_t count, const HakoValueSlot *slots) {
+  JSValue *this_val = hako_handle_ref(&hako_context(ctx)->handles, this_h);
+  JSValue obj, val;
+  JSAtom atom;
+  uint32_t i;
+  int32_t ret;
+
+  if (!this_val) {
+    JS_ThrowReferenceError(ctx, "invalid handle 0x%x", (unsigned)this_h);
+    return -1;
+  }
+  /* setters may release the handle: keep the object alive */
+  obj = JS_DupValue(ctx, *this_val);
+
+  for (i = 0; i < count; i++) {
+    val = hako_slot_decode(ctx, &slots[i]);
+    if (JS_IsException(val))
+      goto fail;
+    atom = hako_batch_atom(ctx, keys, atoms, i);
+    if (atom == JS_ATOM_NULL) {
+      JS_FreeValue(ctx, val);
+      goto fail;
+    }
+    ret = JS_SetProperty(ctx, obj, atom, val);
+    JS_FreeAtom(ctx, atom);
+    if (ret < 0)
+      goto fail;
+  }
+  JS_FreeValue(ctx, obj);
+  return count;
+
+fail:
+  JS_FreeValue(ctx, obj);
+  return -1;
+}
+
+int32_t HAKO_GetProps(JSContext *ctx, HakoHandle this_h,
+                      const HakoPropKey *keys, uint32_t count,
+                      HakoValueSlot *out_slots) {
+  return hako_get_props(ctx, this_h, keys, NULL, count, out_slots);
+}
+
+int32_t HAKO_SetProps(JSContext *ctx, HakoHandle this_h,
+                      const HakoPropKey *keys, uint32_t count,
+                      const HakoValueSlot *slots) {
+  return hako_set_props(ctx, this_h, keys, NULL, count, slots);
+}
+
+int32_t HAKO_GetPropsAtoms(JSContext *ctx, HakoHandle this_h,
+                           const JSAtom *atoms, uint32_t count,
+                           HakoValueSlot *out_slots) {
+  return hako_get_props(ctx, this_h, NULL, atoms, count, out_slots);
+}
+
+int32_t HAKO_SetPropsAtoms(JSContext *ctx, HakoHandle this_h,
+                           const JSAtom *atoms, uint32_t count,
+                           const HakoValueSlot *slots) {
+  return hako_set_props(ctx, this_h, NULL, atoms, count, slots);
+}
+
+/* Atoms */
+
+JSAtom HAKO_NewAtom(JSContext *ctx, const char *name, size_t len) {
+  return JS_NewAtomLen(ctx, name, len);
+}
+
+JSAtom HAKO_ValueToAtom(JSContext *ctx, JSValueConst *val) {
+  return JS_ValueToAtom(ctx, *val);
+}
+
+JSAtom HAKO_DupAtom(JSContext *ctx, JSAtom atom) {
+  return JS_DupAtom(ctx, atom);
+}
+
+void HAKO_FreeAtom(JSContext *ctx, JSAtom atom) { JS_FreeAtom(ctx, atom); }
+
+JSValue *HAKO_AtomToValue(JSContext *ctx, JSAtom atom) {
+  return jsvalue_to_heap(ctx, JS_AtomToValue(ctx, atom));
+}
+
+JSValue *HAKO_GetPropAtom(JSContext *ctx, JSValueConst *this_val,
+                          JSAtom atom) {
+  JSValue prop_val = JS_GetProperty(ctx, *this_val, atom);
+  if (JS_IsException(prop_val))
+    return NULL;
+  return jsvalue_to_heap(ctx, prop_val);
+}
+
+JS_BOOL HAKO_SetPropAtom(JSContext *ctx, JSValueConst *this_val, JSAtom atom,
+                         JSValueConst *prop_value) {
+  return JS_SetProperty(ctx, *this_val, atom, JS_DupValue(ctx, *prop_value));
+}
+
+JS_BOOL HAKO_DefinePropAtom(JSContext *ctx, JSValueConst *this_val,
+                            JSAtom atom, JSValueConst *prop_value,
+                            JSValueConst *get, JSValueConst *set,
+                            JS_BOOL configurable, JS_BOOL enumerable,
+                            JS_BOOL has_value, JS_BOOL has_writable,
+                            JS_BOOL writable) {
+  int32_t flags = hako_define_prop_flags(ctx, get, set, configurable,
+                                         enumerable, has_value, has_writable,
+                                         writable);
+  if (flags < 0)
+    return -1;
+  return JS_DefineProperty(ctx, *this_val, atom, *prop_value, *get, *set,
+                           flags);
+}
+
+HakoHandle HAKO_HandleGetPropAtom(JSContext *ctx, HakoHandle this_h,
+                                  JSAtom atom) {
+  HAKO_HANDLE_ARG(ctx, this_val, this_h);
+  return hako_handle_new(ctx, JS_GetProperty(ctx, *this_val, atom));
+}
+
+JS_BOOL HAKO_HandleSetPropAtom(JSContext *ctx, HakoHandle this_h, JSAtom atom,
+                               HakoHandle val_h) {
+  HakoHandleTable *t = &hako_context(ctx)->handles;
+  JSValue *this_val = hako_handle_ref(t, this_h);
+  JSValue *prop_val = hako_handle_ref(t, val_h);
+
+  if (!this_val || !prop_val) {
+    JS_ThrowReferenceError(ctx, "invalid handle 0x%x",
+                           (unsigned)(!this_val ? this_h : val_h));
+    return -1;
+  }
+  return JS_SetProperty(ctx, *this_val, atom, JS_DupValue(ctx, *prop_val));
+}
+
+/* Strings */
+
+JSValue *HAKO_NewStringUTF8(JSContext *ctx, const char *buf, size_t len) {
+  return jsvalue_to_heap(ctx, JS_NewStringLen(ctx, buf, len));
+}
+
+JSValue *HAKO_NewStringLatin1(JSContext *ctx, const uint8_t *buf, size_t len) {
+  return jsvalue_to_heap(ctx, JS_NewStringLatin1(ctx, buf, len));
+}
+
+JSValue *HAKO_NewStringUTF16(JSContext *ctx, const uint16_t *buf,
+                             size_t len) {
+  return jsvalue_to_heap(ctx, JS_NewStringUTF16(ctx, buf, len));
+}
+
+void *HAKO_NewStringBuffer(JSContext *ctx, size_t len, JS_BOOL is_wide,
+                           JSValue **out_val) {
+  void *buf = NULL;
+  JSValue str = JS_NewStringBuffer(ctx, len, is_wide, &buf);
+
+  *out_val = jsvalue_to_heap(ctx, str);
+  if (!*out_val)
+    return NULL;
+  return buf;
+}
+
+const void *HAKO_GetStringView(JSContext *ctx, JSValue *val,
+                               uint32_t *out_len, JS_BOOL *out_is_wide) {
+  return JS_GetStringView(ctx, val, out_len, out_is_wide);
+}
+
+const void *HAKO_HandleGetStringView(JSContext *ctx, HakoHandle h,
+                                     uint32_t *out_len, JS_BOOL *out_is_wide) {
+  JSValue *val = hako_handle_ref(&hako_context(ctx)->handles, h);
+  if (!val)
+    return NULL;
+  return JS_GetStringView(ctx, val, out_len, out_is_wide);
+}
+
+/* Decoding */
+
+void HAKO_DecodeValue(JSContext *ctx, JSValue *val, HakoValueSlot *out_slot) {
+  hako_slot_describe(ctx, val, out_slot);
+}
+
+int32_t HAKO_HandleDecode(JSContext *ctx, HakoHandle h,
+                          HakoValueSlot *out_slot) {
+  JSValue *val = hako_handle_ref(&hako_context(ctx)->handles, h);
+
+  if (!val) {
+    JS_ThrowReferenceError(ctx, "invalid handle 0x%x", (unsigned)h);
+    hako_slot_encode(ctx, JS_EXCEPTION, out_slot);
+    return -1;
+  }
+  hako_slot_describe(ctx, val, out_slot);
+  return out_slot->tag == HAKO_VALUE_EXCEPTION ? -1 : 0;
+}
+
+int32_t HAKO_CallDecode(JSContext *ctx, JSValueConst *func_obj,
+                        JSValueConst *this_obj, int32_t argc,
+                        JSValueConst **argv_ptrs, HakoValueSlot *out_slot) {
+  JSValueConst argv[argc > 0 ? argc : 1];
+  int64_t fuel_start = JS_GetFuelUsed(ctx);
+  JSValue result;
+  int32_t i;
+
+  for (i = 0; i < argc; i++) {
+    argv[i] = *(argv_ptrs[i]);
+  }
+
+  result = JS_Call(ctx, *func_obj, *this_obj, argc, argv);
+  hako_fuel_record(ctx, fuel_start);
+  hako_slot_encode(ctx, result, out_slot);
+  return out_slot->tag == HAKO_VALUE_EXCEPTION ? -1 : 0;
+}
+
+int32_t HAKO_HandleCallDecode(JSContext *ctx, HakoHandle func_h,
+                              HakoHandle this_h, int32_t argc,
+                              const HakoHandle *argv_handles,
+                              HakoValueSlot *out_slot) {
+  hako_slot_encode(ctx,
+                   hako_handle_call(ctx, func_h, this_h, argc, argv_handles),
+                   out_slot);
+  return out_slot->tag == HAKO_VALUE_EXCEPTION ? -1 : 0;
+}
+
+/* Packed host calls */
+
+/* Arguments up to this count are packed on the C stack. */
+#define HAKO_PACKED_INLINE_ARGS 8
+
+static JSValue hako_call_function_packed(JSContext *ctx, JSValueConst this_val,
+                                         int32_t argc, JSValueConst *argv,
+                                         int32_t magic) {
+  HakoValueSlot inline_slots[HAKO_PACKED_INLINE_ARGS + 1];
+  HakoValueSlot *slots = inline_slots;
+  HakoHandleTable *t = &hako_context(ctx)->handles;
+  HakoValueSlot result;
+  JSValue ret = JS_EXCEPTION;
+  int32_t i, n = 0;
+
+  if (argc > HAKO_PACKED_INLINE_ARGS) {
+    slots = js_malloc(ctx, sizeof(*slots) * (argc + 1));
+    if (!slots)
+      return JS_EXCEPTION;
+  }
+
+  /* slot 0 is this, followed by the arguments */
+  for (n = 0; n <= argc; n++) {
+    hako_slot_encode(ctx, JS_DupValue(ctx, n == 0 ? this_val : argv[n - 1]),
+                     &slots[n]);
+    if (slots[n].tag == HAKO_VALUE_EXCEPTION)
+      goto done;
+  }
+
+  result.tag = HAKO_VALUE_UNDEFINED;
+  result.handle = HAKO_HANDLE_INVALID;
+  result.u.f64 = 0;
+  host_call_function_packed(ctx, argc, slots, &result, magic);
+
+  if (result.tag == HAKO_VALUE_EXCEPTION) {
+    ret = JS_EXCEPTION;
+  } else {
+    ret = hako_slot_decode(ctx, &result);
+    /* a result handle is handed over to us */
+    hako_handle_release(ctx, t, result.handle);
+  }
+
+done:
+  for (i = 0; i < n; i++)
+    hako_handle_release(ctx, t, slots[i].handle);
+  if (slots != inline_slots)
+    js_free(ctx, slots);
+  return ret;
+}
+
+JSValue *HAKO_NewFunctionPacked(JSContext *ctx, int32_t func_id,
+                                const char *name) {
+  JSValue func_obj =
+      JS_NewCFunctionMagic(ctx, hako_call_function_packed, name, 0,
+                           JS_CFUNC_generic_magic, func_id);
+  return jsvalue_to_heap(ctx, func_obj);
+}
+
+/* Wire format */
+
+/* log2 of the element size, indexed by JSTypedArrayEnum */
+static const uint8_t hako_wire_typed_array_size_log2[] = {
+    0, 0, 0, 1, 1, 2, 2, 3, 3, 1, 2, 3,
+};
+
+typedef struct HakoWireReader {
+  JSContext *ctx;
+  const uint8_t *ptr;
+  const uint8_t *end;
+  int depth;
+} HakoWireReader;
+
+/* Returns a pointer to the next len bytes of input and consumes them, or
+   NULL with a pending exception if the input is too short. */
+static const uint8_t *hako_wire_take(HakoWireReader *r, size_t len) {
+  const uint8_t *p = r->ptr;
+
+  if ((size_t)(r->end - r->ptr) < len) {
+    JS_ThrowSyntaxError(r->ctx, "wire: truncated input");
+    return NULL;
+  }
+  r->ptr += len;
+  return p;
+}
+
+/* wasm32 is little-endian, like the wire format */
+static int hako_wire_read(HakoWireReader *r, void *dst, size_t len) {
+  const uint8_t *p = hako_wire_take(r, len);
+  if (!p)
+    return -1;
+  memcpy(dst, p, len);
+  return 0;
+}
+
+static JSValue hako_wire_read_value(HakoWireReader *r);
+
+static JSValue hako_wire_read_array(HakoWireReader *r) {
+  JSContext *ctx = r->ctx;
+  JSValue obj, val;
+  uint32_t count, i;
+
+  if (hako_wire_read(r, &count, 4))
+    return JS_EXCEPTION;
+  obj = JS_NewArray(ctx);
+  if (JS_IsException(obj))
+    return obj;
+  for (i = 0; i < count; i++) {
+    val = hako_wire_read_value(r);
+    if (JS_IsException(val) ||
+        JS_DefinePropertyValueUint32(ctx, obj, i, val, JS_PROP_C_W_E) < 0) {
+      JS_FreeValue(ctx, obj);
+      return JS_EXCEPTION;
+    }
+  }
+  return obj;
+}
+
+static JSValue hako_wire_read_object(HakoWireReader *r) {
+  JSContext *ctx = r->ctx;
+  const uint8_t *key;
+  JSValue obj, val;
+  uint32_t count, len, i;
+  JSAtom atom;
+  int ret;
+
+  if (hako_wire_read(r, &count, 4))
+    return JS_EXCEPTION;
+  obj = JS_NewObject(ctx);
+  if (JS_IsException(obj))
+    return obj;
+  for (i = 0; i < count; i++) {
+    if (hako_wire_read(r, &len, 4) || !(key = hako_wire_take(r, len)))
+      goto fail;
+    atom = JS_NewAtomLen(ctx, (const char *)key, len);
+    if (atom == JS_ATOM_NULL)
+      goto fail;
+    val = hako_wire_read_value(r);
+    if (JS_IsException(val)) {
+      JS_FreeAtom(ctx, atom);
+      goto fail;
+    }
+    ret = JS_DefinePropertyValue(ctx, obj, atom, val, JS_PROP_C_W_E);
+    JS_FreeAtom(ctx, atom);
+    if (ret < 0)
+      goto fail;
+  }
+  return obj;
+
+fail:
+  JS_FreeValue(ctx, obj);
+  return JS_EXCEPTION;
+}
+
+static JSValue hako_wire_read_typed_array(HakoWireReader *r) {
+  JSContext *ctx = r->ctx;
+  const uint8_t *bytes;
+  JSValue buffer, obj;
+  uint32_t len;
+  uint8_t type;
+  int size_log2;
+
+  if (hako_wire_read(r, &type, 1) || hako_wire_read(r, &len, 4))
+    return JS_EXCEPTION;
+  if (type > JS_TYPED_ARRAY_FLOAT64)
+    return JS_ThrowSyntaxError(ctx, "wire: invalid typed array type %u",
+                               (unsigned)type);
+  size_log2 = hako_wire_typed_array_size_log2[type];
+  if (len & ((1U << size_log2) - 1))
+    return JS_ThrowSyntaxError(ctx, "wire: misaligned typed array length");
+  bytes = hako_wire_take(r, len);
+  if (!bytes)
+    return JS_EXCEPTION;
+
+  buffer = JS_NewArrayBufferCopy(ctx, bytes, len);
+  if (JS_IsException(buffer))
+    return buffer;
+  obj = JS_NewTypedArrayWithBuffer(ctx, buffer, 0, len >> size_log2, type);
+  JS_FreeValue(ctx, buffer);
+  return obj;
+}
+
+static JSValue hako_wire_read_value(HakoWireReader *r) {
+  JSContext *ctx = r->ctx;
+  const uint8_t *bytes;
+  JSValue val, *ref;
+  uint32_t len;
+  int32_t i32;
+  double f64;
+  uint8_t tag;
+  void *buf;
+
+  if (hako_wire_read(r, &tag, 1))
+    return JS_EXCEPTION;
+
+  switch (tag) {
+  case HAKO_WIRE_UNDEFINED:
+    return JS_UNDEFINED;
+  case HAKO_WIRE_NULL:
+    return JS_NULL;
+  case HAKO_WIRE_FALSE:
+    return JS_FALSE;
+  case HAKO_WIRE_TRUE:
+    return JS_TRUE;
+  case HAKO_WIRE_INT32:
+    if (hako_wire_read(r, &i32, 4))
+      return JS_EXCEPTION;
+    return JS_NewInt32(ctx, i32);
+  case HAKO_WIRE_FLOAT64:
+    if (hako_wire_read(r, &f64, 8))
+      return JS_EXCEPTION;
+    return JS_NewFloat64(ctx, f64);
+  case HAKO_WIRE_STRING_LATIN1:
+    if (hako_wire_read(r, &len, 4) || !(bytes = hako_wire_take(r, len)))
+      return JS_EXCEPTION;
+    return JS_NewStringLatin1(ctx, bytes, len);
+  case HAKO_WIRE_STRING_UTF16:
+    /* the payload may be unaligned: copy into the string storage */
+    if (hako_wire_read(r, &len, 4) ||
+        !(bytes = hako_wire_take(r, (size_t)len * 2)))
+      return JS_EXCEPTION;
+    val = JS_NewStringBuffer(ctx, len, 1, &buf);
+    if (!JS_IsException(val))
+      memcpy(buf, bytes, (size_t)len * 2);
+    return val;
+  case HAKO_WIRE_STRING_UTF8:
+    if (hako_wire_read(r, &len, 4) || !(bytes = hako_wire_take(r, len)))
+      return JS_EXCEPTION;
+    return JS_NewStringLen(ctx, (const char *)bytes, len);
+  case HAKO_WIRE_ARRAY:
+  case HAKO_WIRE_OBJECT:
+    if (++r->depth > HAKO_WIRE_MAX_DEPTH)
+      return JS_ThrowRangeError(ctx, "wire: nesting too deep");
+    val = tag == HAKO_WIRE_ARRAY ? hako_wire_read_array(r)
+                                 : hako_wire_read_object(r);
+    r->depth--;
+    return val;
+  case HAKO_WIRE_ARRAY_BUFFER:
+    if (hako_wire_read(r, &len, 4) || !(bytes = hako_wire_take(r, len)))
+      return JS_EXCEPTION;
+    return JS_NewArrayBufferCopy(ctx, bytes, len);
+  case HAKO_WIRE_TYPED_ARRAY:
+    return hako_wire_read_typed_array(r);
+  case HAKO_WIRE_HANDLE:
+    if (hako_wire_read(r, &len, 4))
+      return JS_EXCEPTION;
+    /* Constants have their own tags, so only dynamic handles are valid */
+    ref = (len & HAKO_HANDLE_INDEX_MASK) >= HAKO_HANDLE_FIRST_DYNAMIC
+              ? hako_handle_ref(&hako_context(ctx)->handles, len)
+              : NULL;
+    if (!ref)
+      return JS_ThrowReferenceError(ctx, "invalid handle 0x%x", (unsigned)len);
+    return JS_DupValue(ctx, *ref);
+  default:
+    return JS_ThrowSyntaxError(ctx, "wire: invalid tag %u", (unsigned)tag);
+  }
+}
+
+static JSValue hako_wire_decode(JSContext *ctx, const void *buffer,
+                                size_t len) {
+  const uint8_t *p = buffer;
+  HakoWireReader r;
+  JSValue val;
+
+  if (!p || len < HAKO_WIRE_HEADER_SIZE || p[0] != 'H' || p[1] != 'K' ||
+      p[2] != 'W')
+    return JS_ThrowSyntaxError(ctx, "wire: invalid header");
+  if (p[3] != HAKO_WIRE_VERSION)
+    return JS_ThrowSyntaxError(ctx, "wire: unsupported version %u",
+                               (unsigned)p[3]);
+
+  r.ctx = ctx;
+  r.ptr = p + HAKO_WIRE_HEADER_SIZE;
+  r.end = p + len;
+  r.depth = 0;
+  val = hako_wire_read_value(&r);
+  if (!JS_IsException(val) && r.ptr != r.end) {
+    JS_FreeValue(ctx, val);
+    return JS_ThrowSyntaxError(ctx, "wire: trailing bytes after value");
+  }
+  return val;
+}
+
+typedef struct HakoWireWriter {
+  JSContext *ctx;
+  DynBuf dbuf;
+  int depth;
+} HakoWireWriter;
+
+static int hako_wire_write_value(HakoWireWriter *w, JSValueConst val);
+
+static void hako_wire_write_bytes(HakoWireWriter *w, uint8_t tag,
+                                  const void *bytes, uint32_t len,
+                                  size_t byte_len) {
+  dbuf_putc(&w->dbuf, tag);
+  dbuf_put_u32(&w->dbuf, len);
+  if (byte_len)
+    dbuf_put(&w->dbuf, bytes, byte_len);
+}
+
+static int hako_wire_write_string(HakoWireWriter *w, JSValueConst val) {
+  JSValue str = JS_DupValue(w->ctx, val);
+  const void *chars;
+  uint32_t len;
+  JS_BOOL is_wide;
+
+  chars = JS_GetStringView(w->ctx, &str, &len, &is_wide);
+  if (chars) {
+    if (is_wide)
+      hako_wire_write_bytes(w, HAKO_WIRE_STRING_UTF16, chars, len,
+                            (size_t)len * 2);
+    else
+      hako_wire_write_bytes(w, HAKO_WIRE_STRING_LATIN1, chars, len, len);
+  }
+  JS_FreeValue(w->ctx, str);
+  return chars ? 0 : -1;
+}
+
+static int hako_wire_write_array(HakoWireWriter *w, JSValueConst obj) {
+  JSValue val;
+  uint32_t len, i;
+
+  if (HAKO_GetLength(w->ctx, &len, &obj) < 0)
+    return -1;
+  dbuf_putc(&w->dbuf, HAKO_WIRE_ARRAY);
+  dbuf_put_u32(&w->dbuf, len);
+  for (i = 0; i < len; i++) {
+    val = JS_GetPropertyUint32(w->ctx, obj, i);
+    if (JS_IsException(val) || hako_wire_write_value(w, val) < 0) {
+      JS_FreeValue(w->ctx, val);
+      return -1;
+    }
+    JS_FreeValue(w->ctx, val);
+  }
+  return 0;
+}
+
+static int hako_wire_write_object(HakoWireWriter *w, JSValueConst obj) {
+  JSContext *ctx = w->ctx;
+  JSPropertyEnum *tab;
+  const char *key;
+  uint32_t count, i;
+  size_t key_len;
+  JSValue val;
+  int ret = -1;
+
+  if (JS_GetOwnPropertyNames(ctx, &tab, &count, obj,
+                             JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY) < 0)
+    return -1;
+  dbuf_putc(&w->dbuf, HAKO_WIRE_OBJECT);
+  dbuf_put_u32(&w->dbuf, count);
+  for (i = 0; i < count; i++) {
+    key = JS_AtomToCStringLen(ctx, &key_len, tab[i].atom);
+    if (!key)
+      goto done;
+    dbuf_put_u32(&w->dbuf, key_len);
+    dbuf_put(&w->dbuf, (const uint8_t *)key, key_len);
+    JS_FreeCString(ctx, key);
+
+    val = JS_GetProperty(ctx, obj, tab[i].atom);
+    if (JS_IsException(val) || hako_wire_write_value(w, val) < 0) {
+      JS_FreeValue(ctx, val);
+      goto done;
+    }
+    JS_FreeValue(ctx, val);
+  }
+  ret = 0;
+
+done:
+  JS_FreePropertyEnum(ctx, tab, count);
+  return ret;
+}
+
+static int hako_wire_write_binary(HakoWireWriter *w, JSValueConst obj) {
+  JSContext *ctx = w->ctx;
+  size_t offset = 0, len, size;
+  JSValue buffer;
+  uint8_t *data;
+
+  if (JS_IsArrayBuffer(obj)) {
+    data = JS_GetArrayBuffer(ctx, &len, obj);
+    if (!data && JS_HasException(ctx))
+      return -1;
+    hako_wire_write_bytes(w, HAKO_WIRE_ARRAY_BUFFER, data, len, len);
+    return 0;
+  }
+
+  buffer = JS_GetTypedArrayBuffer(ctx, obj, &offset, &len, NULL);
+  if (JS_IsException(buffer))
+    return -1;
+  data = JS_GetArrayBuffer(ctx, &size, buffer);
+  JS_FreeValue(ctx, buffer);
+  if (!data && JS_HasException(ctx))
+    return -1;
+  dbuf_putc(&w->dbuf, HAKO_WIRE_TYPED_ARRAY);
+  hako_wire_write_bytes(w, JS_GetTypedArrayType(obj), data + offset, len, len);
+  return 0;
+}
+
+static int hako_wire_write_value(HakoWireWriter *w, JSValueConst val) {
+  JSContext *ctx = w->ctx;
+  double f64;
+  int ret;
+
+  switch (JS_VALUE_GET_NORM_TAG(val)) {
+  /* allocation failures are sticky in dbuf and reported by the caller */
+  case JS_TAG_UNDEFINED:
+    dbuf_putc(&w->dbuf, HAKO_WIRE_UNDEFINED);
+    return 0;
+  case JS_TAG_NULL:
+    dbuf_putc(&w->dbuf, HAKO_WIRE_NULL);
+    return 0;
+  case JS_TAG_BOOL:
+    dbuf_putc(&w->dbuf,
+              JS_VALUE_GET_BOOL(val) ? HAKO_WIRE_TRUE : HAKO_WIRE_FALSE);
+    return 0;
+  case JS_TAG_INT:
+    dbuf_putc(&w->dbuf, HAKO_WIRE_INT32);
+    dbuf_put_u32(&w->dbuf, (uint32_t)JS_VALUE_GET_INT(val));
+    return 0;
+  case JS_TAG_FLOAT64:
+    f64 = JS_VALUE_GET_FLOAT64(val);
+    dbuf_putc(&w->dbuf, HAKO_WIRE_FLOAT64);
+    dbuf_put(&w->dbuf, (const uint8_t *)&f64, 8);
+    return 0;
+  case JS_TAG_STRING:
+  case JS_TAG_STRING_ROPE:
+    return hako_wire_write_string(w, val);
+  case JS_TAG_OBJECT:
+    if (JS_IsFunction(ctx, val))
+      break;
+    if (JS_IsArrayBuffer(val) || JS_IsTypedArray(val))
+      return hako_wire_write_binary(w, val);
+    if (++w->depth > HAKO_WIRE_MAX_DEPTH) {
+      JS_ThrowRangeError(ctx, "wire: nesting too deep");
+      return -1;
+    }
+    ret = JS_IsArray(ctx, val);
+    if (ret > 0)
+      ret = hako_wire_write_array(w, val);
+    else if (ret == 0)
+      ret = hako_wire_write_object(w, val);
+    w->depth--;
+    return ret;
+  default:
+    break;
+  }
+  JS_ThrowTypeError(ctx, "wire: cannot encode value");
+  return -1;
+}
+
+JSValue *HAKO_WireDecode(JSContext *ctx, const void *buffer, size_t len) {
+  return jsvalue_to_heap(ctx, hako_wire_decode(ctx, buffer, len));
+}
+
+HakoHandle HAKO_HandleWireDecode(JSContext *ctx, const void *buffer,
+                                 size_t len) {
+  return hako_handle_new(ctx, hako_wire_decode(ctx, buffer, len));
+}
+
+void *HAKO_WireEncode(JSContext *ctx, JSValueConst *val, size_t *out_len) {
+  HakoWireWriter w;
+
+  if (!out_len) {
+    JS_ThrowTypeError(ctx, "out_len parameter is required");
+    return NULL;
+  }
+  *out_len = 0;
+
+  w.ctx = ctx;
+  w.depth = 0;
+  dbuf_init2(&w.dbuf, JS_GetRuntime(ctx), (DynBufReallocFunc *)js_realloc_rt);
+  dbuf_put(&w.dbuf, (const uint8_t *)"HKW", 3);
+  dbuf_putc(&w.dbuf, HAKO_WIRE_VERSION);
+  if (hako_wire_write_value(&w, *val) < 0)
+    goto fail;
+  if (w.dbuf.error) {
+    JS_ThrowOutOfMemory(ctx);
+    goto fail;
+  }
+
+  *out_len = w.dbuf.size;
+  return w.dbuf.buf;
+
+fail:
+  dbuf_free(&w.dbuf);
+  return NULL;
+}
+
+/* JSON buffers */
+
+static int hako_byte_buffer_reserve(JSContext *ctx, HakoByteBuffer *buf,
+                                    size_t size) {
+  size_t new_cap;
+  uint8_t *data;
+
+  if (size <= buf->cap)
+    return 0;
+  if (size > UINT32_MAX) {
+    JS_ThrowRangeError(ctx, "byte buffer too large");
+    return -1;
+  }
+  new_cap = buf->cap + buf->cap / 2;
+  if (new_cap < size || new_cap > UINT32_MAX)
+    new_cap = size;
+  data = js_realloc(ctx, buf->data, new_cap);
+  if (!data)
+    return -1;
+  buf->data = data;
+  buf->cap = new_cap;
+  return 0;
+}
+
+/* Appends the UTF-8 encoding of a string. Lone surrogates are encoded as
+   is, like JS_ToCStringLen. */
+static int hako_byte_buffer_put_string(JSContext *ctx, HakoByteBuffer *buf,
+                                       JSValue *str) {
+  const uint8_t *str8;
+  const uint16_t *str16;
+  uint32_t len, i, c;
+  JS_BOOL is_wide;
+  uint8_t *q;
+
+  str8 = JS_GetStringView(ctx, str, &len, &is_wide);
+  if (!str8)
+    return -1;
+  /* worst case: 2 bytes per Latin-1 char, 3 bytes per UTF-16 unit */
+  if (hako_byte_buffer_reserve(ctx, buf,
+                               buf->len + (size_t)len * (is_wide ? 3 : 2)))
+    return -1;
+
+  q = buf->data + buf->len;
+  if (!is_wide) {
+    for (i = 0; i < len; i++) {
+      c = str8[i];
+      if (c < 0x80) {
+        *q++ = c;
+      } else {
+        *q++ = 0xc0 | (c >> 6);
+        *q++ = 0x80 | (c & 0x3f);
+      }
+    }
+  } else {
+    str16 = (const uint16_t *)str8;
+    for (i = 0; i < len; i++) {
+      c = str16[i];
+      if (c < 0x80) {
+        *q++ = c;
+        continue;
+      }
+      if (is_hi_surrogate(c) && i + 1 < len && is_lo_surrogate(str16[i + 1])) {
+        c = from_surrogate(c, str16[i + 1]);
+        i++;
+      }
+      q += unicode_to_utf8(q, c);
+    }
+  }
+  buf->len = q - buf->data;
+  return 0;
+}
+
+int32_t HAKO_ByteBufferReserve(JSContext *ctx, HakoByteBuffer *buf,
+                               uint32_t size) {
+  return hako_byte_buffer_reserve(ctx, buf, size);
+}
+
+void HAKO_ByteBufferFree(JSContext *ctx, HakoByteBuffer *buf) {
+  js_free(ctx, buf->data);
+  buf->data = NULL;
+  buf->len = 0;
+  buf->cap = 0;
+}
+
+int32_t HAKO_ToJsonBuffer(JSContext *ctx, JSValueConst *val, int32_t indent,
+                          HakoByteBuffer *buf, uint32_t size_hint) {
+  JSValue str;
+  int32_t ret = -1;
+
+  buf->len = 0;
+  if (hako_byte_buffer_reserve(ctx, buf, size_hint))
+    return -1;
+
+  if (JS_IsUndefined(*val))
+    str = JS_NewString(ctx, "undefined");
+  else
+    str = JS_JSONStringify(ctx, *val, JS_UNDEFINED, JS_NewInt32(ctx, indent));
+  if (JS_IsException(str))
+    return -1;
+  /* values without a JSON representation produce an empty buffer */
+  if (JS_IsUndefined(str) || hako_byte_buffer_put_string(ctx, buf, &str) == 0)
+    ret = buf->len;
+  JS_FreeValue(ctx, str);
+  return ret;
+}
+
+JSValue *HAKO_ParseJsonSlice(JSContext *ctx, char *json, size_t len,
+                             size_t capacity, const char *filename) {
+  HakoRuntime *hrt = hako_runtime(JS_GetRuntime(ctx));
+  JSValue val;
+  char saved;
+
+  if (!json && len) {
+    return jsvalue_to_heap(ctx, JS_ThrowTypeError(ctx, "Invalid JSON string"));
+  }
+
+  /* the JSON tokenizer expects json[len] == '\0' */
+  if (json && capacity > len) {
+    saved = json[len];
+    json[len] = '\0';
+    val = JS_ParseJSON2(ctx, json, len, filename, JS_PARSE_JSON_EXT);
+    json[len] = saved;
+    return jsvalue_to_heap(ctx, val);
+  }
+
+  if (len + 1 > hrt->json_scratch_size) {
+    char *scratch = js_realloc(ctx, hrt->json_scratch, len + 1);
+    if (!scratch)
+      return jsvalue_to_heap(ctx, JS_EXCEPTION);
+    hrt->json_scratch = scratch;
+    hrt->json_scratch_size = len + 1;
+  }
+  if (len)
+    memcpy(hrt->json_scratch, json, len);
+  hrt->json_scratch[len] = '\0';
+  return jsvalue_to_heap(ctx, JS_ParseJSON2(ctx, hrt->json_scratch, len,
+                                            filename, JS_PARSE_JSON_EXT));
+}
+
+/* Context pool */
+
+struct HakoContextPool {
+  JSRuntime *rt;
+  HAKO_Intrinsic intrinsics;
+  JSContext **idle;
+  int32_t count;
+  int32_t size;
+};
+
+static JSContext *hako_pool_new_context(HakoContextPool *pool) {
+  JSContext *ctx = HAKO_NewContext(pool->rt, pool->intrinsics);
+  HakoContext *hctx;
+
+  if (!ctx)
+    return NULL;
+  hctx = hako_context(ctx);
+  hctx->snapshot = JS_NewContextSnapshot(ctx);
+  if (!hctx->snapshot) {
+    HAKO_FreeContext(ctx);
+    return NULL;
+  }
+  return ctx;
+}
+
+static int hako_pool_push(HakoContextPool *pool, JSContext *ctx) {
+  JSContext **idle;
+  int32_t new_size;
+
+  if (pool->count == pool->size) {
+    new_size = max_int(8, pool->size * 2);
+    idle = js_realloc_rt(pool->rt, pool->idle, sizeof(*idle) * new_size);
+    if (!idle)
+      return -1;
+    pool->idle = idle;
+    pool->size = new_size;
+  }
+  pool->idle[pool->count++] = ctx;
+  return 0;
+}
+
+static int hako_context_reset(JSContext *ctx) {
+  HakoContext *hctx = hako_context(ctx);
+
+  if (!hctx || !hctx->snapshot)
+    return -1;
+  JS_FreeValue(ctx, JS_GetException(ctx));
+  HAKO_HandleFreeAll(ctx);
+  /* pending loads are dropped; their late fetches report stale tokens */
+  hako_module_loader_free(ctx, &hctx->loader);
+  hctx->host_data = NULL;
+  /* the next tenant must not inherit an exhausted fuel budget or the
+     memory limits of the previous one */
+  JS_SetFuel(ctx, -1);
+  hctx->last_call_fuel = 0;
+  JS_SetContextMemoryLimits(ctx, 0, 0);
+  return JS_RestoreContextSnapshot(ctx, hctx->snapshot);
+}
+
+HakoContextPool *HAKO_NewContextPool(JSRuntime *rt, HAKO_Intrinsic intrinsics,
+                                     int32_t prewarm) {
+  HakoContextPool *pool = js_mallocz_rt(rt, sizeof(HakoContextPool));
+  JSContext *ctx;
+  int32_t i;
+
+  if (!pool)
+    return NULL;
+  pool->rt = rt;
+  pool->intrinsics = intrinsics;
+  for (i = 0; i < prewarm; i++) {
+    ctx = hako_pool_new_context(pool);
+    if (!ctx || hako_pool_push(pool, ctx) < 0) {
+      if (ctx)
+        HAKO_FreeContext(ctx);
+      HAKO_FreeContextPool(pool);
+      return NULL;
+    }
+  }
+  return pool;
+}
+
+void HAKO_FreeContextPool(HakoContextPool *pool) {
+  int32_t i;
+
+  if (!pool)
+    return;
+  for (i = 0; i < pool->count; i++)
+    HAKO_FreeContext(pool->idle[i]);
+  js_free_rt(pool->rt, pool->idle);
+  js_free_rt(pool->rt, pool);
+}
+
+JSContext *HAKO_ContextPoolAcquire(HakoContextPool *pool) {
+  if (pool->count > 0)
+    return pool->idle[--pool->count];
+  return hako_pool_new_context(pool);
+}
+
+int32_t HAKO_ContextPoolRelease(HakoContextPool *pool, JSContext *ctx) {
+  if (hako_context_reset(ctx) < 0 || hako_pool_push(pool, ctx) < 0) {
+    /* state that cannot be restored (or a foreign context) is discarded */
+    JS_FreeValue(ctx, JS_GetException(ctx));
+    HAKO_FreeContext(ctx);
+    return 0;
+  }
+  return 1;
+}
+
+int32_t HAKO_ContextPoolIdleCount(HakoContextPool *pool) {
+  return pool->count;
+}
+
+/* Runtime images */
+
+int32_t HAKO_RuntimeImagePrepare(JSRuntime *rt) {
+  return JS_PrepareRuntimeImage(rt);
+}
+
+int32_t HAKO_RuntimeImageResume(JSRuntime *rt) {
+  return JS_ResumeRuntimeImage(rt);
+}
+
+/* Fuel */
+
+void HAKO_SetFuel(JSContext *ctx, int64_t fuel) { JS_SetFuel(ctx, fuel); }
+
+int64_t HAKO_GetFuel(JSContext *ctx) { return JS_GetFuel(ctx); }
+
+int64_t HAKO_GetFuelUsed(JSContext *ctx) { return JS_GetFuelUsed(ctx); }
+
+int64_t HAKO_GetLastCallFuel(JSContext *ctx) {
+  return hako_context(ctx)->last_call_fuel;
+}
+
+/* Context memory */
+
+int32_t HAKO_ContextSetMemoryLimits(JSContext *ctx, int64_t soft_limit,
+                                    int64_t hard_limit) {
+  return JS_SetContextMemoryLimits(ctx, soft_limit, hard_limit);
+}
+
+int32_t HAKO_ContextGetMemoryUsage(JSContext *ctx, HakoContextMemoryUsage *out) {
+  JSContextMemoryUsage s;
+
+  if (JS_GetContextMemoryUsage(ctx, &s) < 0)
+    return -1;
+  out->malloc_size = s.malloc_size;
+  out->malloc_count = s.malloc_count;
+  out->soft_limit = s.soft_limit;
+  out->hard_limit = s.hard_limit;
+  return 0;
+}
+
+/* Module cache */
+
+void HAKO_RuntimeEnableModuleCache(JSRuntime *rt, JS_BOOL enabled) {
+  HakoModuleCache *cache = &hako_runtime(rt)->module_cache;
+
+  cache->enabled = enabled != 0;
+  if (!cache->enabled)
+    hako_module_cache_clear(rt, cache);
+}
+
+void HAKO_ModuleCacheClear(JSRuntime *rt) {
+  hako_module_cache_clear(rt, &hako_runtime(rt)->module_cache);
+}
+
+void HAKO_ModuleCacheGetStats(JSRuntime *rt, HakoModuleCacheStats *out) {
+  HakoModuleCache *cache = &hako_runtime(rt)->module_cache;
+
+  out->hits = cache->hits;
+  out->misses = cache->misses;
+  out->entries = cache->count;
+  out->reserved = 0;
+  out->bytes = cache->bytes;
+}
+
+/* Asynchronous module loading */
+
+static void hako_module_load_free(JSContext *ctx, HakoModuleLoad *load) {
+  js_free(ctx, load->base_name);
+  js_free(ctx, load->specifier);
+  js_free(ctx, load->name);
+  JS_FreeValue(ctx, load->resolving_funcs[0]);
+  JS_FreeValue(ctx, load->resolving_funcs[1]);
+}
+
+static void hako_module_failures_clear(JSContext *ctx,
+                                       HakoModuleLoader *loader) {
+  int32_t i;
+
+  for (i = 0; i < loader->failure_count; i++) {
+    js_free(ctx, loader->failures[i].name);
+    JS_FreeValue(ctx, loader->failures[i].reason);
+  }
+  loader->failure_count = 0;
+}
+
+static void hako_module_loader_free(JSContext *ctx, HakoModuleLoader *loader) {
+  int32_t i;
+
+  /* the name of a fetch being completed (token 0) belongs to
+     HAKO_CompleteModuleFetch, which may be what is running the host code
+     resetting the loader */
+  for (i = 0; i < loader->fetch_count; i++) {
+    if (loader->fetches[i].token != 0)
+      js_free(ctx, loader->fetches[i].name);
+  }
+  for (i = 0; i < loader->load_count; i++)
+    hako_module_load_free(ctx, &loader->loads[i]);
+  hako_module_failures_clear(ctx, loader);
+  js_free(ctx, loader->fetches);
+  js_free(ctx, loader->loads);
+  js_free(ctx, loader->failures);
+  loader->fetches = NULL;
+  loader->fetch_count = loader->fetch_size = 0;
+  loader->loads = NULL;
+  loader->load_count = loader->load_size = 0;
+  loader->failures = NULL;
+  loader->failure_size = 0;
+}
+
+/* make room for one more element of size 'elem_size' in '*parray' */
+static int hako_array_reserve(JSContext *ctx, void **parray, int32_t *psize,
+                              int32_t count, size_t elem_size) {
+  int32_t new_size;
+  void *array;
+
+  if (count < *psize)
+    return 0;
+  new_size = max_int(8, *psize * 2);
+  array = js_realloc(ctx, *parray, elem_size * new_size);
+  if (!array)
+    return -1;
+  *parray = array;
+  *psize = new_size;
+  return 0;
+}
+
+static int hako_module_fetch_find(HakoModuleLoader *loader, const char *name) {
+  int32_t i;
+
+  for (i = 0; i < loader->fetch_count; i++) {
+    if (!strcmp(loader->fetches[i].name, name))
+      return i;
+  }
+  return -1;
+}
+
+/* find the fetch being completed, whose name is 'name' itself */
+static int hako_module_fetch_find_completing(HakoModuleLoader *loader,
+                                             const char *name) {
+  int32_t i;
+
+  for (i = 0; i < loader->fetch_count; i++) {
+    if (loader->fetches[i].name == name)
+      return i;
+  }
+  return -1;
+}
+
+static int hako_module_failure_find(HakoModuleLoader *loader,
+                                    const char *name) {
+  int32_t i;
+
+  for (i = 0; i < loader->failure_count; i++) {
+    if (!strcmp(loader->failures[i].name, name))
+      return i;
+  }
+  return -1;
+}
+
+/* ask the host for 'name' unless it is already on its way. The host may
+   complete the fetch before returning. */
+static int hako_module_fetch_start(JSContext *ctx, HakoModuleLoader *loader,
+                                   const char *name) {
+  JSRuntime *rt = JS_GetRuntime(ctx);
+  HakoModuleFetch *f;
+  char *name_copy;
+  uint32_t token;
+
+  if (hako_module_fetch_find(loader, name) >= 0)
+    return 0;
+  if (hako_array_reserve(ctx, (void **)&loader->fetches, &loader->fetch_size,
+                         loader->fetch_count, sizeof(*loader->fetches)) < 0)
+    return -1;
+  name_copy = js_strdup(ctx, name);
+  if (!name_copy)
+    return -1;
+  token = ++loader->next_token;
+  if (token == 0)
+    token = ++loader->next_token;
+  f = &loader->fetches[loader->fetch_count++];
+  f->token = token;
+  f->name = name_copy;
+  host_fetch_module(rt, ctx, name_copy, token,
+                    hako_runtime(rt)->module_fetch_opaque);
+  return 0;
+}
+
+typedef struct HakoModuleScan {
+  JSModuleDef **modules; /* visited modules, also the work list */
+  int32_t count;
+  int32_t size;
+  int32_t missing;
+  int32_t failure; /* index in loader->failures, -1 if none reached */
+} HakoModuleScan;
+
+static int hako_module_scan_name(JSContext *ctx, HakoModuleLoader *loader,
+                                 HakoModuleScan *scan, const char *name) {
+  JSModuleDef *m;
+  int32_t i;
+
+  m = JS_FindLoadedModule(ctx, name);
+  if (!m) {
+    scan->failure = hako_module_failure_find(loader, name);
+    if (scan->failure >= 0)
+      return 0;
+    scan->missing++;
+    return hako_module_fetch_start(ctx, loader, name);
+  }
+  for (i = 0; i < scan->count; i++) {
+    if (scan->modules[i] == m)
+      return 0;
+  }
+  if (hako_array_reserve(ctx, (void **)&scan->modules, &scan->size,
+                         scan->count, sizeof(*scan->modules)) < 0)
+    return -1;
+  scan->modules[scan->count++] = m;
+  return 0;
+}
+
+/* walk the loaded part of the graph rooted at 'name', fetching what is
+   missing. Stops early when a failed module is reached. */
+static int hako_module_scan(JSContext *ctx, HakoModuleLoader *loader,
+                            HakoModuleScan *scan, const char *name) {
+  const char *base_name, *request;
+  JSModuleDef *m;
+  JSAtom atom;
+  char *req_name;
+  int32_t i, j, n, ret;
+
+  if (hako_module_scan_name(ctx, loader, scan, name) < 0)
+    return -1;
+  for (i = 0; i < scan->count && scan->failure < 0; i++) {
+    m = scan->modules[i];
+    atom = JS_GetModuleName(ctx, m);
+    base_name = JS_AtomToCString(ctx, atom);
+    JS_FreeAtom(ctx, atom);
+    if (!base_name)
+      return -1;
+    n = JS_GetModuleRequestCount(m);
+    ret = 0;
+    for (j = 0; j < n && scan->failure < 0 && ret == 0; j++) {
+      atom = JS_GetModuleRequest(ctx, m, j);
+      request = JS_AtomToCString(ctx, atom);
+      JS_FreeAtom(ctx, atom);
+      if (!request) {
+        ret = -1;
+        break;
+      }
+      req_name = JS_NormalizeModuleName(ctx, base_name, request);
+      JS_FreeCString(ctx, request);
+      if (!req_name) {
+        ret = -1;
+        break;
+      }
+      ret = hako_module_scan_name(ctx, loader, scan, req_name);
+      js_free(ctx, req_name);
+    }
+    JS_FreeCString(ctx, base_name);
+    if (ret < 0)
+      return -1;
+  }
+  return 0;
+}
+
+static void hako_module_settle(JSContext *ctx, JSValueConst func,
+                               JSValueConst arg) {
+  JS_FreeValue(ctx, JS_Call(ctx, func, JS_UNDEFINED, 1, &arg));
+}
+
+/* advance every waiting load: fetch what its graph lacks, evaluate it
+   when complete and reject it when a module of its graph failed.
+   Completions that arrive while pumping are picked up by the outermost
+   pump. */
+static void hako_module_pump(JSContext *ctx) {
+  HakoModuleLoader *loader = &hako_context(ctx)->loader;
+  HakoModuleScan scan;
+  HakoModuleLoad load;
+  JSValue reason;
+  int32_t i, ret;
+
+  if (loader->pumping) {
+    loader->dirty = TRUE;
+    return;
+  }
+  loader->pumping = TRUE;
+  memset(&scan, 0, sizeof(scan));
+  do {
+    loader->dirty = FALSE;
+    i = 0;
+    while (i < loader->load_count) {
+      scan.count = 0;
+      scan.missing = 0;
+      scan.failure = -1;
+      ret = hako_module_scan(ctx, loader, &scan, loader->loads[i].name);
+      if (ret == 0 && scan.failure < 0 && scan.missing > 0) {
+        i++;
+        continue;
+      }
+      /* the load is done one way or another: take it out first as
+         evaluating it may start new loads */
+      load = loader->loads[i];
+      loader->load_count--;
+      memmove(&loader->loads[i], &loader->loads[i + 1],
+              sizeof(*loader->loads) * (loader->load_count - i));
+      if (ret < 0) {
+        reason = JS_GetException(ctx);
+        hako_module_settle(ctx, load.resolving_funcs[1], reason);
+        JS_FreeValue(ctx, reason);
+      } else if (scan.failure >= 0) {
+        hako_module_settle(ctx, load.resolving_funcs[1],
+                           loader->failures[scan.failure].reason);
+      } else {
+        JS_LoadModuleWithFuncs(ctx, load.base_name, load.specifier,
+                               (JSValueConst *)load.resolving_funcs);
+      }
+      hako_module_load_free(ctx, &load);
+    }
+  } while (loader->dirty);
+  js_free(ctx, scan.modules);
+  hako_module_failures_clear(ctx, loader);
+  loader->pumping = FALSE;
+}
+
+static int hako_module_load_start(JSContext *ctx, const char *base_name,
+                                  const char *specifier,
+                                  JSValueConst *resolving_funcs) {
+  HakoModuleLoader *loader = &hako_context(ctx)->loader;
+  HakoModuleLoad *load;
+
+  if (hako_array_reserve(ctx, (void **)&loader->loads, &loader->load_size,
+                         loader->load_count, sizeof(*loader->loads)) < 0)
+    return -1;
+  load = &loader->loads[loader->load_count];
+  load->base_name = js_strdup(ctx, base_name);
+  load->specifier = js_strdup(ctx, specifier);
+  load->name = JS_NormalizeModuleName(ctx, base_name, specifier);
+  if (!load->base_name || !load->specifier || !load->name) {
+    js_free(ctx, load->base_name);
+    js_free(ctx, load->specifier);
+    js_free(ctx, load->name);
+    return -1;
+  }
+  load->resolving_funcs[0] = JS_DupValue(ctx, resolving_funcs[0]);
+  load->resolving_funcs[1] = JS_DupValue(ctx, resolving_funcs[1]);
+  loader->load_count++;
+  hako_module_pump(ctx);
+  return 0;
+}
+
+static int hako_module_import_hook(JSContext *ctx, const char *base_name,
+                                   const char *name, JSValueConst attributes,
+                                   JSValueConst *resolving_funcs,
+                                   void *opaque) {
+  return hako_module_load_start(ctx, base_name, name, resolving_funcs);
+}
+
+typedef struct HakoImportScan {
+  HakoModuleLoader *loader;
+  const char *base_name;
+  DynBuf names; /* NUL terminated names, for HAKO_ScanModuleImports */
+} HakoImportScan;
+
+static int hako_prefetch_import(JSContext *ctx, const char *specifier,
+                                void *opaque) {
+  HakoImportScan *scan = opaque;
+  HakoModuleLoader *loader = scan->loader;
+  char *name;
+  int ret = 0;
+
+  /* stop if a fetch function reset the loader */
+  if (hako_module_fetch_find_completing(loader, scan->base_name) < 0)
+    return 0;
+  name = JS_NormalizeModuleName(ctx, scan->base_name, specifier);
+  if (!name)
+    return -1;
+  if (strcmp(name, scan->base_name) != 0 &&
+      hako_module_failure_find(loader, name) < 0 &&
+      !JS_FindLoadedModule(ctx, name))
+    ret = hako_module_fetch_start(ctx, loader, name);
+  js_free(ctx, name);
+  return ret;
+}
+
+/* start the fetches of the imports of a module about to be compiled. This
+   is only a head start: the graph walk after compilation catches what the
+   scan got wrong. */
+static void hako_module_prefetch(JSContext *ctx, HakoModuleLoader *loader,
+                                 const char *name, const char *source,
+                                 size_t length) {
+  HakoImportScan scan;
+
+  scan.loader = loader;
+  scan.base_name = name;
+  if (JS_ScanModuleImports(ctx, source, length, name, hako_prefetch_import,
+                           &scan) < 0)
+    JS_FreeValue(ctx, JS_GetException(ctx));
+}
+
+static JSModuleDef *hako_module_read_bytecode(JSContext *ctx,
+                                              const char *module_name,
+                                              const void *data,
+                                              size_t length) {
+  JSModuleDef *m = NULL;
+  const char *name;
+  JSValue obj;
+  JSAtom atom;
+
+  obj = JS_ReadObject(ctx, data, length, JS_READ_OBJ_BYTECODE);
+  if (JS_IsException(obj))
+    return NULL;
+  if (!JS_VALUE_IS_MODULE(obj)) {
+    JS_ThrowTypeError(ctx, "Module '%s' bytecode is not a module",
+                      module_name);
+    goto done;
+  }
+  /* the graph is looked up by name */
+  atom = JS_GetModuleName(ctx, JS_VALUE_GET_PTR(obj));
+  name = JS_AtomToCString(ctx, atom);
+  JS_FreeAtom(ctx, atom);
+  if (!name)
+    goto done;
+  if (strcmp(name, module_name) != 0) {
+    JS_ThrowTypeError(ctx, "Module '%s' bytecode was compiled as '%s'",
+                      module_name, name);
+    JS_FreeCString(ctx, name);
+    goto done;
+  }
+  JS_FreeCString(ctx, name);
+  if (hako_module_set_import_meta(ctx, obj, TRUE, FALSE) < 0)
+    goto done;
+  m = JS_VALUE_GET_PTR(obj);
+
+done:
+  JS_FreeValue(ctx, obj);
+  return m;
+}
+
+void HAKO_RuntimeEnableAsyncModuleLoader(JSRuntime *rt, void *opaque) {
+  hako_runtime(rt)->module_fetch_opaque = opaque;
+  JS_SetModuleImportHook(rt, hako_module_import_hook, NULL);
+}
+
+void HAKO_RuntimeDisableAsyncModuleLoader(JSRuntime *rt) {
+  JS_SetModuleImportHook(rt, NULL, NULL);
+}
+
+JSValue *HAKO_LoadModuleAsync(JSContext *ctx, const char *base_name,
+                              const char *specifier) {
+  JSValue promise, resolving_funcs[2];
+
+  promise = JS_NewPromiseCapability(ctx, resolving_funcs);
+  if (JS_IsException(promise))
+    return jsvalue_to_heap(ctx, promise);
+  if (hako_module_load_start(ctx, base_name ? base_name : "", specifier,
+                             (JSValueConst *)resolving_funcs) < 0) {
+    JS_FreeValue(ctx, promise);
+    promise = JS_EXCEPTION;
+  }
+  JS_FreeValue(ctx, resolving_funcs[0]);
+  JS_FreeValue(ctx, resolving_funcs[1]);
+  return jsvalue_to_heap(ctx, promise);
+}
+
+int32_t HAKO_CompleteModuleFetch(JSContext *ctx, uint32_t token,
+                                 HakoModuleFetchResult kind,
+                                 const void *data, size_t length) {
+  HakoModuleLoader *loader = &hako_context(ctx)->loader;
+  HakoModuleFailure *failure;
+  JSModuleDef *m = NULL;
+  char *name, *source;
+  int32_t i, pumping;
+
+  if (token == 0)
+    return -1;
+  for (i = 0; i < loader->fetch_count; i++) {
+    if (loader->fetches[i].token == token)
+      break;
+  }
+  if (i == loader->fetch_count)
+    return -1;
+  /* the module stays in flight until compiled so that fetches started
+     meanwhile do not ask for it again; pumping is held off as well */
+  name = loader->fetches[i].name;
+  loader->fetches[i].token = 0;
+  pumping = loader->pumping;
+  loader->pumping = TRUE;
+
+  switch (kind) {
+  case HAKO_MODULE_FETCH_SOURCE:
+    source = js_malloc(ctx, length + 1);
+    if (!source)
+      break;
+    memcpy(source, data, length);
+    source[length] = '\0';
+    /* ask for the imports before spending time compiling */
+    if (!hako_module_cache_has(JS_GetRuntime(ctx), name, source, length))
+      hako_module_prefetch(ctx, loader, name, source, length);
+    if (hako_module_fetch_find_completing(loader, name) >= 0)
+      m = hako_compile_module(ctx, name, source, FALSE);
+    js_free(ctx, source);
+    break;
+  case HAKO_MODULE_FETCH_BYTECODE:
+    m = hako_module_read_bytecode(ctx, name, data, length);
+    break;
+  case HAKO_MODULE_FETCH_ERROR:
+  default:
+    if (data && length > 0)
+      JS_ThrowTypeError(ctx, "Module '%s' could not be loaded: %.*s", name,
+                        (int)length, (const char *)data);
+    else
+      JS_ThrowTypeError(
+          ctx,
+          "Module not found: '%s'. Please check that the module name is "
+          "correct and the module is available in your environment.",
+          name);
+    break;
+  }
+
+  loader->pumping = pumping;
+  i = hako_module_fetch_find_completing(loader, name);
+  if (i < 0) {
+    /* the loader was reset meanwhile, e.g. by a fetch function returning
+       the context to its pool */
+    js_free(ctx, name);
+    if (!m)
+      JS_FreeValue(ctx, JS_GetException(ctx));
+    return -1;
+  }
+  loader->fetches[i] = loader->fetches[--loader->fetch_count];
+  if (m) {
+    js_free(ctx, name);
+  } else if (hako_array_reserve(ctx, (void **)&loader->failures,
+                                &loader->failure_size, loader->failure_count,
+                                sizeof(*loader->failures)) < 0) {
+    /* out of memory: the next scan fetches the module again */
+    js_free(ctx, name);
+    JS_FreeValue(ctx, JS_GetException(ctx));
+  } else {
+    failure = &loader->failures[loader->failure_count++];
+    failure->name = name;
+    failure->reason = JS_GetException(ctx);
+  }
+  hako_module_pump(ctx);
+  return 0;
+}
+
+int32_t HAKO_PendingModuleLoadCount(JSContext *ctx) {
+  return hako_context(ctx)->loader.load_count;
+}
+
+/* Import scanning */
+
+static int hako_scan_import(JSContext *ctx, const char *specifier,
+                            void *opaque) {
+  HakoImportScan *scan = opaque;
+  char *name;
+
+  name = JS_NormalizeModuleName(ctx, scan->base_name, specifier);
+  if (!name)
+    return -1;
+  dbuf_put(&scan->names, (const uint8_t *)name, strlen(name) + 1);
+  js_free(ctx, name);
+  return 0;
+}
+
+char *HAKO_ScanModuleImports(JSContext *ctx, const char *source,
+                             size_t source_len, const char *module_name,
+                             uint32_t *out_count) {
+  HakoImportScan scan;
+  int count;
+
+  *out_count = 0;
+  scan.loader = NULL;
+  scan.base_name = module_name;
+  dbuf_init2(&scan.names, JS_GetRuntime(ctx),
+             (DynBufReallocFunc *)js_realloc_rt);
+  count = JS_ScanModuleImports(ctx, source, source_len, module_name,
+                               hako_scan_import, &scan);
+  if (count < 0)
+    goto fail;
+  /* never return NULL on success */
+  dbuf_putc(&scan.names, '\0');
+  if (scan.names.error) {
+    JS_ThrowOutOfMemory(ctx);
+    goto fail;
+  }
+  *out_count = count;
+  return (char *)scan.names.buf;
+
+fail:
+  dbuf_free(&scan.names);
+  return NULL;
+}
+
+/* Lazy function compilation */
+
+void HAKO_RuntimeEnableLazyFunctions(JSRuntime *rt, JS_BOOL enabled) {
+  JS_SetLazyFunctions(rt, enabled);
+}
+
+void HAKO_LazyFunctionGetStats(JSRuntime *rt, HakoLazyFunctionStats *out) {
+  JSLazyFunctionStats stats;
+
+  JS_GetLazyFunctionStats(rt, &stats);
+  out->skipped = stats.skipped_count;
+  out->compiled = stats.compiled_count;
+}
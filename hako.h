@@ -79,10 +79,224 @@ typedef enum {
   HAKO_TYPE_FUNCTION = 7
 } HAKOTypeOf;
 
+//! Pool of contexts that are reset to their initial state when released
+typedef struct HakoContextPool HakoContextPool;
+
+//! Handle to a value in the per-context handle table. Handles are plain
+//! integers: creating, reading and releasing them never allocates per value.
+typedef uint32_t HakoHandle;
+
+//! Reserved handles, valid in every context and never freed.
+//! HAKO_HANDLE_INVALID and HAKO_HANDLE_EXCEPTION are result codes only:
+//! passing them as an argument fails with "invalid handle".
+typedef enum HakoHandleConstant {
+  HAKO_HANDLE_INVALID = 0,
+  HAKO_HANDLE_UNDEFINED = 1,
+  HAKO_HANDLE_NULL = 2,
+  HAKO_HANDLE_FALSE = 3,
+  HAKO_HANDLE_TRUE = 4,
+  HAKO_HANDLE_EXCEPTION = 5,
+} HakoHandleConstant;
+
+//! Type tag of a HakoValueSlot
+typedef enum HakoValueTag {
+  HAKO_VALUE_UNDEFINED = 0,
+  HAKO_VALUE_NULL = 1,
+  HAKO_VALUE_BOOL = 2,
+  HAKO_VALUE_INT32 = 3,
+  HAKO_VALUE_FLOAT64 = 4,
+  HAKO_VALUE_STRING = 5,
+  HAKO_VALUE_SYMBOL = 6,
+  HAKO_VALUE_BIGINT = 7,
+  HAKO_VALUE_OBJECT = 8,
+  HAKO_VALUE_FUNCTION = 9,
+  HAKO_VALUE_EXCEPTION = 10,
+} HakoValueTag;
+
+//! Set in HakoValueSlot.u.str.len when the string characters are UTF-16
+#define HAKO_STRING_WIDE (1U << 31)
+
+//! Packed value exchanged through linear memory. Primitives are stored
+//! inline; strings, symbols, bigints and objects are referenced by handle.
+//! Strings also carry a borrowed view of their characters, valid as long as
+//! the string is alive.
+typedef struct HakoValueSlot {
+  int32_t tag;       /* HakoValueTag */
+  HakoHandle handle; /* value handle for reference types, else HAKO_HANDLE_INVALID */
+  union {
+    int32_t i32;     /* HAKO_VALUE_INT32 and HAKO_VALUE_BOOL */
+    double f64;      /* HAKO_VALUE_FLOAT64 */
+    struct {
+      const void* ptr; /* Latin-1 (NUL terminated) or UTF-16 characters */
+      uint32_t len;    /* length in characters, ORed with HAKO_STRING_WIDE */
+    } str;           /* HAKO_VALUE_STRING */
+  } u;
+} HakoValueSlot;
+
+//! UTF-8 property key, not NUL terminated
+typedef struct HakoPropKey {
+  const char* name;
+  uint32_t len;
+} HakoPropKey;
+
+//! Growable byte buffer in linear memory, shared with the host. The host
+//! reads data[0..len) directly; hako grows data with the context allocator.
+//! Zero-initialize before first use and free with HAKO_ByteBufferFree.
+typedef struct HakoByteBuffer {
+  uint8_t* data;
+  uint32_t len;
+  uint32_t cap;
+} HakoByteBuffer;
+
+//! Interrupt state in linear memory, written by the host and checked by
+//! the engine on every interrupt poll without leaving wasm
+typedef struct HakoInterruptState {
+  //! Nonzero requests an interrupt. Stays set until the host clears it.
+  uint32_t requested;
+  uint32_t reserved;
+  //! Monotonic clock deadline in nanoseconds, 0 for none
+  uint64_t deadline_ns;
+} HakoInterruptState;
+
+//! Runtime creation flags
+typedef enum HAKO_RuntimeFlag {
+  //! Charge allocations to the context making them, enabling per-context
+  //! memory usage and limits. Costs 8 bytes per allocation.
+  HAKO_RUNTIME_CONTEXT_MEMORY = 1 << 0,
+} HAKO_RuntimeFlag;
+
+//! Memory charged to one context, maintained incrementally
+typedef struct HakoContextMemoryUsage {
+  //! Bytes allocated, including allocator overhead
+  int64_t malloc_size;
+  //! Live allocations
+  int64_t malloc_count;
+  int64_t soft_limit;
+  int64_t hard_limit;
+} HakoContextMemoryUsage;
+
+//! Jobs run for one context during a drain
+typedef struct HakoJobContextStats {
+  //! Realm of the jobs. May have been freed since if only jobs held it.
+  JSContext* ctx;
+  int32_t executed;
+  int32_t failed;
+} HakoJobContextStats;
+
+//! Limits and results of HAKO_DrainJobs. Zero-initialize, set the limits
+//! and optionally provide a stats array.
+typedef struct HakoJobDrain {
+  //! Maximum jobs to run, 0 for no limit
+  int32_t max_jobs;
+  int32_t reserved;
+  //! Maximum fuel the jobs may consume in total, 0 for no limit. Checked
+  //! between jobs.
+  int64_t max_fuel;
+  //! Monotonic clock deadline in nanoseconds, 0 for none. Checked between jobs.
+  uint64_t deadline_ns;
+  //! Per-context stats, host owned, may be NULL
+  HakoJobContextStats* contexts;
+  //! Capacity of contexts
+  int32_t contexts_capacity;
+  //! Out: entries used in contexts. Contexts beyond capacity are only counted in the totals.
+  int32_t contexts_count;
+  //! Out: jobs run
+  int32_t executed;
+  //! Out: jobs that threw
+  int32_t failed;
+  //! Out: fuel consumed by the jobs
+  int64_t fuel_used;
+  //! Out: realm of the first failed job, or NULL. Caller owns a reference, release with HAKO_ReleaseContext.
+  JSContext* error_ctx;
+  //! Out: exception of the first failed job, or NULL. Caller owns, free with HAKO_FreeValuePointerRuntime.
+  JSValue* error;
+} HakoJobDrain;
+
+//! Module bytecode cache counters
+typedef struct HakoModuleCacheStats {
+  uint64_t hits;
+  uint64_t misses;
+  uint32_t entries;
+  uint32_t reserved;
+  //! Bytecode and source bytes held
+  uint64_t bytes;
+} HakoModuleCacheStats;
+
+//! How the host completes a module fetch
+typedef enum HakoModuleFetchResult {
+  //! Data is the module source text
+  HAKO_MODULE_FETCH_SOURCE = 0,
+  //! Data is module bytecode from HAKO_CompileToByteCode
+  HAKO_MODULE_FETCH_BYTECODE = 1,
+  //! The module is unavailable. Data is an optional UTF-8 message.
+  HAKO_MODULE_FETCH_ERROR = 2,
+} HakoModuleFetchResult;
+
+//! Lazy function compilation counters
+typedef struct HakoLazyFunctionStats {
+  //! Functions whose bytecode generation was deferred
+  uint64_t skipped;
+  //! Deferred functions compiled by their first call
+  uint64_t compiled;
+} HakoLazyFunctionStats;
+
+//! Hako wire format, version 1
+//!
+//! A compact host-writable encoding of structured values. A buffer starts
+//! with the 4-byte header 'H' 'K' 'W' HAKO_WIRE_VERSION, followed by exactly
+//! one value. A value is a one-byte HakoWireTag followed by its payload.
+//! Integers and floats are little-endian and need not be aligned; lengths
+//! are u32.
+//!
+//!   UNDEFINED, NULL, FALSE, TRUE   no payload
+//!   INT32                          i32
+//!   FLOAT64                        f64
+//!   STRING_LATIN1                  u32 length, length bytes
+//!   STRING_UTF16                   u32 length in code units, 2 * length bytes
+//!   STRING_UTF8                    u32 byte length, bytes (not NUL terminated)
+//!   ARRAY                          u32 count, count values
+//!   OBJECT                         u32 count, count (key, value) pairs; a key
+//!                                  is a u32 byte length and UTF-8 bytes
+//!   ARRAY_BUFFER                   u32 byte length, bytes
+//!   TYPED_ARRAY                    u8 JSTypedArrayEnum, u32 byte length, bytes
+//!   HANDLE                         u32 HakoHandle of an existing value; the
+//!                                  reserved handles are rejected
+//!
+//! Objects decode to plain objects with data properties, in key order.
+//! Typed arrays and array buffers decode to fresh copies of their bytes.
+#define HAKO_WIRE_VERSION 1
+#define HAKO_WIRE_HEADER_SIZE 4
+
+//! Nesting limit for arrays and objects in the wire format
+#define HAKO_WIRE_MAX_DEPTH 1000
+
+//! Value tag of the Hako wire format
+typedef enum HakoWireTag {
+  HAKO_WIRE_UNDEFINED = 0,
+  HAKO_WIRE_NULL = 1,
+  HAKO_WIRE_FALSE = 2,
+  HAKO_WIRE_TRUE = 3,
+  HAKO_WIRE_INT32 = 4,
+  HAKO_WIRE_FLOAT64 = 5,
+  HAKO_WIRE_STRING_LATIN1 = 6,
+  HAKO_WIRE_STRING_UTF16 = 7,
+  HAKO_WIRE_STRING_UTF8 = 8,
+  HAKO_WIRE_ARRAY = 9,
+  HAKO_WIRE_OBJECT = 10,
+  HAKO_WIRE_ARRAY_BUFFER = 11,
+  HAKO_WIRE_TYPED_ARRAY = 12,
+  HAKO_WIRE_HANDLE = 13,
+} HakoWireTag;
+
 //! Creates a new runtime
 //! @return New runtime or NULL on failure. Caller owns, free with HAKO_FreeRuntime.
 HAKO_EXPORT("HAKO_NewRuntime") extern JSRuntime* HAKO_NewRuntime(void);
 
+//! Creates a new runtime with options
+//! @param flags Bitmask of HAKO_RuntimeFlag
+//! @return New runtime or NULL on failure. Caller owns, free with HAKO_FreeRuntime.
+HAKO_EXPORT("HAKO_NewRuntimeWithFlags") extern JSRuntime* HAKO_NewRuntimeWithFlags(uint32_t flags);
+
 //! Frees a runtime and all associated resources
 //! @param rt Runtime to free, consumed
 HAKO_EXPORT("HAKO_FreeRuntime") extern void HAKO_FreeRuntime(JSRuntime* rt);
@@ -125,6 +339,14 @@ HAKO_EXPORT("HAKO_IsJobPending") extern JS_BOOL HAKO_IsJobPending(JSRuntime* rt)
 //! @return Number of jobs executed, or -1 on error
 HAKO_EXPORT("HAKO_ExecutePendingJob") extern int32_t HAKO_ExecutePendingJob(JSRuntime* rt, int32_t max_jobs_to_execute, JSContext** out_last_job_ctx);
 
+//! Runs pending jobs in order until the queue is empty or a limit in drain
+//! is hit. A job that throws does not stop the drain: the first exception
+//! is kept in drain->error and later ones are counted and discarded.
+//! @param rt Runtime to execute in
+//! @param drain Limits in, results out. Host owns.
+//! @return 1 if jobs remain pending, 0 if the queue was drained
+HAKO_EXPORT("HAKO_DrainJobs") extern int32_t HAKO_DrainJobs(JSRuntime* rt, HakoJobDrain* drain);
+
 //! Enables interrupt handler for runtime
 //! @param rt Runtime to configure
 //! @param opaque User data passed to host handler. Host borrows.
@@ -134,6 +356,22 @@ HAKO_EXPORT("HAKO_RuntimeEnableInterruptHandler") extern void HAKO_RuntimeEnable
 //! @param rt Runtime to configure
 HAKO_EXPORT("HAKO_RuntimeDisableInterruptHandler") extern void HAKO_RuntimeDisableInterruptHandler(JSRuntime* rt);
 
+//! Enables interrupts driven by an in-memory flag and deadline. Polls read
+//! the returned state directly; the host handler is only consulted once
+//! the flag is set or the deadline has passed, and only if call_host is set.
+//! Replaces any handler installed by HAKO_RuntimeEnableInterruptHandler.
+//! @param rt Runtime to configure
+//! @param call_host If nonzero, call the host interrupt handler when the state fires and interrupt only if it returns nonzero; otherwise interrupt immediately
+//! @param opaque User data passed to host handler. Host borrows.
+//! @return Interrupt state, cleared. Runtime owns, valid until HAKO_FreeRuntime.
+HAKO_EXPORT("HAKO_RuntimeEnableInterruptState") extern HakoInterruptState* HAKO_RuntimeEnableInterruptState(JSRuntime* rt, int32_t call_host, void* opaque);
+
+//! Sets how many interrupt poll sites (loop back edges, calls) are passed
+//! between two interrupt checks. Takes effect after the next check.
+//! @param rt Runtime to configure
+//! @param ticks Poll count, or 0 or less for the default (10000)
+HAKO_EXPORT("HAKO_RuntimeSetInterruptInterval") extern void HAKO_RuntimeSetInterruptInterval(JSRuntime* rt, int32_t ticks);
+
 //! Sets promise rejection handler for runtime
 //! @param rt Runtime to configure
 //! @param opaque User data passed to host handler. Host borrows.
@@ -178,6 +416,12 @@ HAKO_EXPORT("HAKO_GetContextData") extern void* HAKO_GetContextData(JSContext* c
 //! @param ctx Context to free, consumed
 HAKO_EXPORT("HAKO_FreeContext") extern void HAKO_FreeContext(JSContext* ctx);
 
+//! Releases a context reference returned by another call, such as
+//! HakoJobDrain.error_ctx. Unlike HAKO_FreeContext, the context state is
+//! kept for its owner.
+//! @param ctx Context reference, consumed
+HAKO_EXPORT("HAKO_ReleaseContext") extern void HAKO_ReleaseContext(JSContext* ctx);
+
 //! Gets pointer to undefined constant
 //! @return Pointer to static undefined. Never free.
 HAKO_EXPORT("HAKO_GetUndefined") extern JSValueConst* HAKO_GetUndefined(void);
@@ -210,6 +454,29 @@ HAKO_EXPORT("HAKO_FreeValuePointer") extern void HAKO_FreeValuePointer(JSContext
 //! @param val Value to free, consumed
 HAKO_EXPORT("HAKO_FreeValuePointerRuntime") extern void HAKO_FreeValuePointerRuntime(JSRuntime* rt, JSValue* val);
 
+//! Opens a value scope. Until the matching HAKO_ScopeClose, every value pointer
+//! returned by the runtime is allocated from a scope arena instead of the heap.
+//! @param rt Runtime to open the scope in
+//! @return New scope depth, or -1 on allocation failure
+HAKO_EXPORT("HAKO_ScopeOpen") extern int32_t HAKO_ScopeOpen(JSRuntime* rt);
+
+//! Closes the innermost scope, freeing every value allocated since it was opened.
+//! Pointers from the closed scope must not be used afterwards.
+//! @param rt Runtime to close the scope in
+//! @return Remaining scope depth, or -1 if no scope was open
+HAKO_EXPORT("HAKO_ScopeClose") extern int32_t HAKO_ScopeClose(JSRuntime* rt);
+
+//! Gets the number of open scopes
+//! @param rt Runtime to query
+//! @return Current scope depth
+HAKO_EXPORT("HAKO_ScopeDepth") extern int32_t HAKO_ScopeDepth(JSRuntime* rt);
+
+//! Moves a scoped value to the heap so that it outlives its scope
+//! @param ctx Context to allocate from
+//! @param val Value pointer, consumed if scoped. Unscoped pointers are returned unchanged.
+//! @return Heap value pointer or NULL on allocation failure. Caller owns, free with HAKO_FreeValuePointer.
+HAKO_EXPORT("HAKO_ScopeEscape") extern JSValue* HAKO_ScopeEscape(JSContext* ctx, JSValue* val);
+
 //! Allocates memory from context allocator
 //! @param ctx Context to allocate from
 //! @param size Bytes to allocate
@@ -790,6 +1057,578 @@ HAKO_EXPORT("HAKO_CleanupTypeStripper") extern void HAKO_CleanupTypeStripper(JSR
 //! @return HAKO_Status indicating success or specific error type
 HAKO_EXPORT("HAKO_StripTypes") extern HAKO_Status HAKO_StripTypes(JSRuntime* rt, const char* typescript_source, char** javascript_out, size_t* javascript_len);
 
+//! Creates a handle for a value
+//! @param ctx Context that owns the handle table
+//! @param val Value to reference, duplicated. Host owns.
+//! @return New handle, or HAKO_HANDLE_EXCEPTION on failure. Caller owns, free with HAKO_HandleFree.
+HAKO_EXPORT("HAKO_HandleNew") extern HakoHandle HAKO_HandleNew(JSContext* ctx, JSValueConst* val);
+
+//! Boxes the value referenced by a handle
+//! @param ctx Context that owns the handle
+//! @param h Handle to read. Host owns.
+//! @return New value pointer. Caller owns, free with HAKO_FreeValuePointer.
+HAKO_EXPORT("HAKO_HandleToPointer") extern JSValue* HAKO_HandleToPointer(JSContext* ctx, HakoHandle h);
+
+//! Duplicates a handle, incrementing the value refcount
+//! @param ctx Context that owns the handle
+//! @param h Handle to duplicate. Host owns.
+//! @return New handle, or HAKO_HANDLE_EXCEPTION if h is invalid. Caller owns, free with HAKO_HandleFree.
+HAKO_EXPORT("HAKO_HandleDup") extern HakoHandle HAKO_HandleDup(JSContext* ctx, HakoHandle h);
+
+//! Releases a handle. Stale and reserved handles are ignored.
+//! @param ctx Context that owns the handle
+//! @param h Handle to release, consumed
+HAKO_EXPORT("HAKO_HandleFree") extern void HAKO_HandleFree(JSContext* ctx, HakoHandle h);
+
+//! Releases several handles in one call
+//! @param ctx Context that owns the handles
+//! @param handles Array of handles to release, each consumed. Host owns the array.
+//! @param count Number of handles
+HAKO_EXPORT("HAKO_HandleFreeMany") extern void HAKO_HandleFreeMany(JSContext* ctx, const HakoHandle* handles, uint32_t count);
+
+//! Releases every live handle of a context. Outstanding handles become stale.
+//! @param ctx Context whose handles are released
+HAKO_EXPORT("HAKO_HandleFreeAll") extern void HAKO_HandleFreeAll(JSContext* ctx);
+
+//! Gets the number of live handles
+//! @param ctx Context to query
+//! @return Live handle count, excluding reserved handles
+HAKO_EXPORT("HAKO_HandleCount") extern uint32_t HAKO_HandleCount(JSContext* ctx);
+
+//! Gets and clears the pending exception
+//! @param ctx Context to query
+//! @return Exception handle, or HAKO_HANDLE_NULL if none pending. Caller owns, free with HAKO_HandleFree.
+HAKO_EXPORT("HAKO_HandleGetException") extern HakoHandle HAKO_HandleGetException(JSContext* ctx);
+
+//! Gets the global object
+//! @param ctx Context to use
+//! @return Global object handle. Caller owns, free with HAKO_HandleFree.
+HAKO_EXPORT("HAKO_HandleGetGlobalObject") extern HakoHandle HAKO_HandleGetGlobalObject(JSContext* ctx);
+
+//! Creates a new empty object
+//! @param ctx Context to create in
+//! @return New object handle. Caller owns, free with HAKO_HandleFree.
+HAKO_EXPORT("HAKO_HandleNewObject") extern HakoHandle HAKO_HandleNewObject(JSContext* ctx);
+
+//! Creates a new array
+//! @param ctx Context to create in
+//! @return New array handle. Caller owns, free with HAKO_HandleFree.
+HAKO_EXPORT("HAKO_HandleNewArray") extern HakoHandle HAKO_HandleNewArray(JSContext* ctx);
+
+//! Creates a new number value
+//! @param ctx Context to create in
+//! @param num Number value
+//! @return New number handle. Caller owns, free with HAKO_HandleFree.
+HAKO_EXPORT("HAKO_HandleNewFloat64") extern HakoHandle HAKO_HandleNewFloat64(JSContext* ctx, double num);
+
+//! Creates a new string value
+//! @param ctx Context to create in
+//! @param str C string. Host owns.
+//! @return New string handle. Caller owns, free with HAKO_HandleFree.
+HAKO_EXPORT("HAKO_HandleNewString") extern HakoHandle HAKO_HandleNewString(JSContext* ctx, const char* str);
+
+//! Converts the value of a handle to a double
+//! @param ctx Context to use
+//! @param h Handle to convert. Host owns.
+//! @return Double value, or NAN on error
+HAKO_EXPORT("HAKO_HandleGetFloat64") extern double HAKO_HandleGetFloat64(JSContext* ctx, HakoHandle h);
+
+//! Converts the value of a handle to a C string
+//! @param ctx Context to use
+//! @param h Handle to convert. Host owns.
+//! @return C string or NULL on error. Caller owns, free with HAKO_FreeCString.
+HAKO_EXPORT("HAKO_HandleToCString") extern const char* HAKO_HandleToCString(JSContext* ctx, HakoHandle h);
+
+//! Gets the type of the value of a handle
+//! @param ctx Context to use
+//! @param h Handle to check. Host owns.
+//! @return HAKOTypeOf enum value, HAKO_TYPE_UNDEFINED for invalid handles
+HAKO_EXPORT("HAKO_HandleTypeOf") extern HAKOTypeOf HAKO_HandleTypeOf(JSContext* ctx, HakoHandle h);
+
+//! Gets a property by name
+//! @param ctx Context to use
+//! @param this_h Object to get property from. Host owns.
+//! @param prop_h Property name. Host owns.
+//! @return Property value handle, or HAKO_HANDLE_EXCEPTION on error. Caller owns, free with HAKO_HandleFree.
+HAKO_EXPORT("HAKO_HandleGetProp") extern HakoHandle HAKO_HandleGetProp(JSContext* ctx, HakoHandle this_h, HakoHandle prop_h);
+
+//! Gets a property by numeric index
+//! @param ctx Context to use
+//! @param this_h Object to get property from. Host owns.
+//! @param prop_index Property index
+//! @return Property value handle, or HAKO_HANDLE_EXCEPTION on error. Caller owns, free with HAKO_HandleFree.
+HAKO_EXPORT("HAKO_HandleGetPropNumber") extern HakoHandle HAKO_HandleGetPropNumber(JSContext* ctx, HakoHandle this_h, int32_t prop_index);
+
+//! Sets a property value
+//! @param ctx Context to use
+//! @param this_h Object to set property on. Host owns.
+//! @param prop_h Property name. Host owns.
+//! @param val_h Property value. Host owns.
+//! @return 1 on success, 0 on failure, -1 on exception
+HAKO_EXPORT("HAKO_HandleSetProp") extern JS_BOOL HAKO_HandleSetProp(JSContext* ctx, HakoHandle this_h, HakoHandle prop_h, HakoHandle val_h);
+
+//! Calls a JavaScript function
+//! @param ctx Context to use
+//! @param func_h Function to call. Host owns.
+//! @param this_h This binding. Host owns.
+//! @param argc Argument count
+//! @param argv_handles Array of argument handles. Host owns.
+//! @return Result handle, or HAKO_HANDLE_EXCEPTION on error. Caller owns, free with HAKO_HandleFree.
+HAKO_EXPORT("HAKO_HandleCall") extern HakoHandle HAKO_HandleCall(JSContext* ctx, HakoHandle func_h, HakoHandle this_h, int32_t argc, const HakoHandle* argv_handles);
+
+//! Reads several properties of an object in one call
+//! @param ctx Context to use
+//! @param this_h Object to read from. Host owns.
+//! @param keys Array of UTF-8 property keys. Host owns.
+//! @param count Number of keys
+//! @param out_slots Output array of count slots. Handles written to it are owned by the caller, free with HAKO_HandleFree.
+//! @return Number of properties read, or -1 on exception (the failing slot is tagged HAKO_VALUE_EXCEPTION)
+HAKO_EXPORT("HAKO_GetProps") extern int32_t HAKO_GetProps(JSContext* ctx, HakoHandle this_h, const HakoPropKey* keys, uint32_t count, HakoValueSlot* out_slots);
+
+//! Sets several properties of an object in one call
+//! @param ctx Context to use
+//! @param this_h Object to set properties on. Host owns.
+//! @param keys Array of UTF-8 property keys. Host owns.
+//! @param count Number of keys
+//! @param slots Array of count values. Host owns, handles are not consumed.
+//! @return Number of properties set, or -1 on exception
+HAKO_EXPORT("HAKO_SetProps") extern int32_t HAKO_SetProps(JSContext* ctx, HakoHandle this_h, const HakoPropKey* keys, uint32_t count, const HakoValueSlot* slots);
+
+//! Reads several properties keyed by pre-interned atoms in one call
+//! @param ctx Context to use
+//! @param this_h Object to read from. Host owns.
+//! @param atoms Array of atoms from HAKO_NewAtom. Host owns.
+//! @param count Number of atoms
+//! @param out_slots Output array of count slots. Handles written to it are owned by the caller, free with HAKO_HandleFree.
+//! @return Number of properties read, or -1 on exception (the failing slot is tagged HAKO_VALUE_EXCEPTION)
+HAKO_EXPORT("HAKO_GetPropsAtoms") extern int32_t HAKO_GetPropsAtoms(JSContext* ctx, HakoHandle this_h, const JSAtom* atoms, uint32_t count, HakoValueSlot* out_slots);
+
+//! Sets several properties keyed by pre-interned atoms in one call
+//! @param ctx Context to use
+//! @param this_h Object to set properties on. Host owns.
+//! @param atoms Array of atoms from HAKO_NewAtom. Host owns.
+//! @param count Number of atoms
+//! @param slots Array of count values. Host owns, handles are not consumed.
+//! @return Number of properties set, or -1 on exception
+HAKO_EXPORT("HAKO_SetPropsAtoms") extern int32_t HAKO_SetPropsAtoms(JSContext* ctx, HakoHandle this_h, const JSAtom* atoms, uint32_t count, const HakoValueSlot* slots);
+
+//! Interns a property name. Atoms are shared by all contexts of a runtime.
+//! @param ctx Context to use
+//! @param name UTF-8 name, not necessarily NUL terminated. Host owns.
+//! @param len Name length in bytes
+//! @return New atom, or 0 on error. Caller owns, free with HAKO_FreeAtom.
+HAKO_EXPORT("HAKO_NewAtom") extern JSAtom HAKO_NewAtom(JSContext* ctx, const char* name, size_t len);
+
+//! Converts a value (string, number or symbol) to an atom
+//! @param ctx Context to use
+//! @param val Value to convert. Host owns.
+//! @return New atom, or 0 on error. Caller owns, free with HAKO_FreeAtom.
+HAKO_EXPORT("HAKO_ValueToAtom") extern JSAtom HAKO_ValueToAtom(JSContext* ctx, JSValueConst* val);
+
+//! Duplicates an atom
+//! @param ctx Context to use
+//! @param atom Atom to duplicate. Host owns.
+//! @return The same atom. Caller owns the new reference, free with HAKO_FreeAtom.
+HAKO_EXPORT("HAKO_DupAtom") extern JSAtom HAKO_DupAtom(JSContext* ctx, JSAtom atom);
+
+//! Frees an atom
+//! @param ctx Context to use
+//! @param atom Atom to free, consumed
+HAKO_EXPORT("HAKO_FreeAtom") extern void HAKO_FreeAtom(JSContext* ctx, JSAtom atom);
+
+//! Converts an atom to a string or symbol value
+//! @param ctx Context to use
+//! @param atom Atom to convert. Host owns.
+//! @return New value. Caller owns, free with HAKO_FreeValuePointer.
+HAKO_EXPORT("HAKO_AtomToValue") extern JSValue* HAKO_AtomToValue(JSContext* ctx, JSAtom atom);
+
+//! Gets a property by atom
+//! @param ctx Context to use
+//! @param this_val Object to get property from. Host owns.
+//! @param atom Property atom. Host owns.
+//! @return Property value or NULL on error. Caller owns, free with HAKO_FreeValuePointer.
+HAKO_EXPORT("HAKO_GetPropAtom") extern JSValue* HAKO_GetPropAtom(JSContext* ctx, JSValueConst* this_val, JSAtom atom);
+
+//! Sets a property by atom
+//! @param ctx Context to use
+//! @param this_val Object to set property on. Host owns.
+//! @param atom Property atom. Host owns.
+//! @param prop_val Property value. Host owns.
+//! @return 1 on success, 0 on failure, -1 on exception
+HAKO_EXPORT("HAKO_SetPropAtom") extern JS_BOOL HAKO_SetPropAtom(JSContext* ctx, JSValueConst* this_val, JSAtom atom, JSValueConst* prop_val);
+
+//! Defines a property by atom with descriptor
+//! @param ctx Context to use
+//! @param this_val Object to define property on. Host owns.
+//! @param atom Property atom. Host owns.
+//! @param prop_val Property value (if has_value is true)
+//! @param getter Getter function or undefined
+//! @param setter Setter function or undefined
+//! @param configurable Property is configurable
+//! @param enumerable Property is enumerable
+//! @param has_value Descriptor includes value
+//! @param has_writable Descriptor includes writable
+//! @param writable Property is writable (if has_writable)
+//! @return 1 on success, 0 on failure, -1 on exception
+HAKO_EXPORT("HAKO_DefinePropAtom") extern JS_BOOL HAKO_DefinePropAtom(JSContext* ctx, JSValueConst* this_val, JSAtom atom, JSValueConst* prop_val, JSValueConst* getter, JSValueConst* setter, JS_BOOL configurable, JS_BOOL enumerable, JS_BOOL has_value, JS_BOOL has_writable, JS_BOOL writable);
+
+//! Gets a property by atom
+//! @param ctx Context to use
+//! @param this_h Object to get property from. Host owns.
+//! @param atom Property atom. Host owns.
+//! @return Property value handle, or HAKO_HANDLE_EXCEPTION on error. Caller owns, free with HAKO_HandleFree.
+HAKO_EXPORT("HAKO_HandleGetPropAtom") extern HakoHandle HAKO_HandleGetPropAtom(JSContext* ctx, HakoHandle this_h, JSAtom atom);
+
+//! Sets a property by atom
+//! @param ctx Context to use
+//! @param this_h Object to set property on. Host owns.
+//! @param atom Property atom. Host owns.
+//! @param val_h Property value. Host owns.
+//! @return 1 on success, 0 on failure, -1 on exception
+HAKO_EXPORT("HAKO_HandleSetPropAtom") extern JS_BOOL HAKO_HandleSetPropAtom(JSContext* ctx, HakoHandle this_h, JSAtom atom, HakoHandle val_h);
+
+//! Creates a string from length-delimited UTF-8
+//! @param ctx Context to create in
+//! @param buf UTF-8 bytes, need not be NUL terminated. Host owns.
+//! @param len Length in bytes
+//! @return New string value. Caller owns, free with HAKO_FreeValuePointer.
+HAKO_EXPORT("HAKO_NewStringUTF8") extern JSValue* HAKO_NewStringUTF8(JSContext* ctx, const char* buf, size_t len);
+
+//! Creates a string from Latin-1 bytes with a single copy and no decoding
+//! @param ctx Context to create in
+//! @param buf Latin-1 bytes. Host owns.
+//! @param len Length in bytes
+//! @return New string value. Caller owns, free with HAKO_FreeValuePointer.
+HAKO_EXPORT("HAKO_NewStringLatin1") extern JSValue* HAKO_NewStringLatin1(JSContext* ctx, const uint8_t* buf, size_t len);
+
+//! Creates a string from UTF-16 code units with a single copy and no decoding
+//! @param ctx Context to create in
+//! @param buf UTF-16 code units. Host owns.
+//! @param len Length in code units
+//! @return New string value. Caller owns, free with HAKO_FreeValuePointer.
+HAKO_EXPORT("HAKO_NewStringUTF16") extern JSValue* HAKO_NewStringUTF16(JSContext* ctx, const uint16_t* buf, size_t len);
+
+//! Allocates a string and returns its character storage so the host can write
+//! the contents in place, avoiding any intermediate buffer. The contents must
+//! be fully written before the string is used.
+//! @param ctx Context to create in
+//! @param len Length in characters
+//! @param is_wide True for UTF-16 storage (2 bytes per character), false for Latin-1
+//! @param out_val Output string value. Caller owns, free with HAKO_FreeValuePointer.
+//! @return Writable character storage, or NULL on error. Valid while the string is alive.
+HAKO_EXPORT("HAKO_NewStringBuffer") extern void* HAKO_NewStringBuffer(JSContext* ctx, size_t len, JS_BOOL is_wide, JSValue** out_val);
+
+//! Borrows the characters of a string without copying. String ropes are
+//! flattened first, which replaces *val with the flat string.
+//! @param ctx Context to use
+//! @param val String value. Host owns.
+//! @param out_len Output length in characters
+//! @param out_is_wide Output, true for UTF-16 storage, false for NUL terminated Latin-1
+//! @return Read-only characters, or NULL if val is not a string. Valid while val is alive.
+HAKO_EXPORT("HAKO_GetStringView") extern const void* HAKO_GetStringView(JSContext* ctx, JSValue* val, uint32_t* out_len, JS_BOOL* out_is_wide);
+
+//! Borrows the characters of a string handle without copying
+//! @param ctx Context to use
+//! @param h String handle. Host owns.
+//! @param out_len Output length in characters
+//! @param out_is_wide Output, true for UTF-16 storage, false for NUL terminated Latin-1
+//! @return Read-only characters, or NULL if h is not a string. Valid while h is alive.
+HAKO_EXPORT("HAKO_HandleGetStringView") extern const void* HAKO_HandleGetStringView(JSContext* ctx, HakoHandle h, uint32_t* out_len, JS_BOOL* out_is_wide);
+
+//! Decodes a value into a packed slot without allocating. Strings get a
+//! borrowed character view; no handle is created for reference types.
+//! @param ctx Context to use
+//! @param val Value to decode. Host owns. String ropes are flattened in place.
+//! @param out_slot Output slot. HAKO_VALUE_EXCEPTION, with the exception pending, if flattening a rope fails.
+HAKO_EXPORT("HAKO_DecodeValue") extern void HAKO_DecodeValue(JSContext* ctx, JSValue* val, HakoValueSlot* out_slot);
+
+//! Decodes the value of a handle into a packed slot without allocating
+//! @param ctx Context to use
+//! @param h Handle to decode. Host owns.
+//! @param out_slot Output slot. Its handle field is left as HAKO_HANDLE_INVALID.
+//! @return 0 on success, -1 if h is invalid or the string view failed
+HAKO_EXPORT("HAKO_HandleDecode") extern int32_t HAKO_HandleDecode(JSContext* ctx, HakoHandle h, HakoValueSlot* out_slot);
+
+//! Calls a JavaScript function and decodes its result into a packed slot
+//! @param ctx Context
+//! @param func_obj Function to call. Host owns.
+//! @param this_obj This binding. Host owns.
+//! @param argc Argument count
+//! @param argv_ptrs Array of argument pointers. Host owns.
+//! @param out_slot Output slot. A handle written to it is owned by the caller, free with HAKO_HandleFree.
+//! @return 0 on success, -1 on exception (out_slot is tagged HAKO_VALUE_EXCEPTION)
+HAKO_EXPORT("HAKO_CallDecode") extern int32_t HAKO_CallDecode(JSContext* ctx, JSValueConst* func_obj, JSValueConst* this_obj, int32_t argc, JSValueConst** argv_ptrs, HakoValueSlot* out_slot);
+
+//! Calls a JavaScript function by handle and decodes its result into a packed slot
+//! @param ctx Context
+//! @param func_h Function to call. Host owns.
+//! @param this_h This binding. Host owns.
+//! @param argc Argument count
+//! @param argv_handles Array of argument handles. Host owns.
+//! @param out_slot Output slot. A handle written to it is owned by the caller, free with HAKO_HandleFree.
+//! @return 0 on success, -1 on exception (out_slot is tagged HAKO_VALUE_EXCEPTION)
+HAKO_EXPORT("HAKO_HandleCallDecode") extern int32_t HAKO_HandleCallDecode(JSContext* ctx, HakoHandle func_h, HakoHandle this_h, int32_t argc, const HakoHandle* argv_handles, HakoValueSlot* out_slot);
+
+//! Creates a new JavaScript function that calls back to host through the
+//! packed calling convention. The host import call_function_packed receives
+//! argc + 1 decoded slots (this first, then the arguments) and writes its
+//! return value into a result slot; no per-argument calls are needed.
+//! Argument handles are released when the host returns, dup to keep them.
+//! A handle written to the result slot is taken over by the callee, and
+//! a result tagged HAKO_VALUE_EXCEPTION throws the pending exception.
+//! @param ctx Context
+//! @param func_id Host function ID to invoke when called
+//! @param name Function name. Host owns.
+//! @return New function value. Caller owns, free with HAKO_FreeValuePointer.
+HAKO_EXPORT("HAKO_NewFunctionPacked") extern JSValue* HAKO_NewFunctionPacked(JSContext* ctx, int32_t func_id, const char* name);
+
+//! Decodes a value from the Hako wire format (see HakoWireTag)
+//! @param ctx Context
+//! @param buffer Encoded buffer including the header. Host owns.
+//! @param len Buffer length in bytes. Trailing bytes after the value are an error.
+//! @return Decoded value, or an exception on malformed input. Caller owns, free with HAKO_FreeValuePointer.
+HAKO_EXPORT("HAKO_WireDecode") extern JSValue* HAKO_WireDecode(JSContext* ctx, const void* buffer, size_t len);
+
+//! Decodes a value from the Hako wire format into a handle
+//! @param ctx Context
+//! @param buffer Encoded buffer including the header. Host owns.
+//! @param len Buffer length in bytes
+//! @return Handle to the decoded value, or HAKO_HANDLE_EXCEPTION. Caller owns, free with HAKO_HandleFree.
+HAKO_EXPORT("HAKO_HandleWireDecode") extern HakoHandle HAKO_HandleWireDecode(JSContext* ctx, const void* buffer, size_t len);
+
+//! Encodes a value to the Hako wire format. Other objects than arrays,
+//! array buffers and typed arrays are written as plain objects with their
+//! own enumerable string-keyed properties. Functions and symbols throw.
+//! @param ctx Context
+//! @param val Value to encode. Host owns.
+//! @param out_len Output pointer for buffer length
+//! @return Encoded buffer, or NULL on exception. Caller owns, free with HAKO_Free.
+HAKO_EXPORT("HAKO_WireEncode") extern void* HAKO_WireEncode(JSContext* ctx, JSValueConst* val, size_t* out_len);
+
+//! Reserves capacity in a byte buffer
+//! @param ctx Context
+//! @param buf Buffer. Host owns.
+//! @param size Minimum capacity in bytes
+//! @return 0 on success, -1 on out of memory
+HAKO_EXPORT("HAKO_ByteBufferReserve") extern int32_t HAKO_ByteBufferReserve(JSContext* ctx, HakoByteBuffer* buf, uint32_t size);
+
+//! Frees the storage of a byte buffer and resets it to empty
+//! @param ctx Context
+//! @param buf Buffer. Host owns.
+HAKO_EXPORT("HAKO_ByteBufferFree") extern void HAKO_ByteBufferFree(JSContext* ctx, HakoByteBuffer* buf);
+
+//! Serializes a value to UTF-8 JSON directly into a byte buffer
+//! @param ctx Context
+//! @param val Value to stringify. Host owns.
+//! @param indent Indentation level for formatting
+//! @param buf Output buffer, overwritten from offset 0. Host owns.
+//! @param size_hint Expected output size in bytes, reserved up front
+//! @return Length in bytes, or -1 on exception
+HAKO_EXPORT("HAKO_ToJsonBuffer") extern int32_t HAKO_ToJsonBuffer(JSContext* ctx, JSValueConst* val, int32_t indent, HakoByteBuffer* buf, uint32_t size_hint);
+
+//! Parses JSON from a slice that need not be NUL terminated. If the slice
+//! has at least one byte of slack (capacity > len), json[len] is borrowed
+//! as the terminator during the call and restored, so no copy is made.
+//! @param ctx Context
+//! @param json JSON text. Host owns.
+//! @param len Length in bytes
+//! @param capacity Writable size of the memory at json, in bytes
+//! @param filename Filename for error reporting. Host owns.
+//! @return Parsed value. Caller owns, free with HAKO_FreeValuePointer.
+HAKO_EXPORT("HAKO_ParseJsonSlice") extern JSValue* HAKO_ParseJsonSlice(JSContext* ctx, char* json, size_t len, size_t capacity, const char* filename);
+
+//! Creates a pool of contexts sharing one intrinsics configuration. Each
+//! pooled context records its initial state once; releasing it restores
+//! the global object, the intrinsic prototypes and constructors and the
+//! namespace objects, and drops global lexical variables, loaded modules,
+//! pending jobs, handles and context data. Mutations of objects deeper in
+//! the builtin graph (e.g. properties added to a builtin method) survive.
+//! @param rt Runtime
+//! @param intrinsics Intrinsics bitmask, as for HAKO_NewContext
+//! @param prewarm Number of contexts to create up front
+//! @return New pool or NULL on failure. Caller owns, free with HAKO_FreeContextPool.
+HAKO_EXPORT("HAKO_NewContextPool") extern HakoContextPool* HAKO_NewContextPool(JSRuntime* rt, HAKO_Intrinsic intrinsics, int32_t prewarm);
+
+//! Frees a pool and its idle contexts. Acquired contexts are not affected.
+//! @param pool Pool to free
+HAKO_EXPORT("HAKO_FreeContextPool") extern void HAKO_FreeContextPool(HakoContextPool* pool);
+
+//! Takes a pristine context from the pool, creating one if none is idle
+//! @param pool Pool
+//! @return Context or NULL on failure. Caller owns, return with HAKO_ContextPoolRelease or free with HAKO_FreeContext.
+HAKO_EXPORT("HAKO_ContextPoolAcquire") extern JSContext* HAKO_ContextPoolAcquire(HakoContextPool* pool);
+
+//! Resets a context and returns it to the pool. The context must not be
+//! running. Contexts whose state cannot be restored are freed instead.
+//! @param pool Pool
+//! @param ctx Context from HAKO_ContextPoolAcquire. Ownership transfers to the pool.
+//! @return 1 if the context was recycled, 0 if it was freed
+HAKO_EXPORT("HAKO_ContextPoolRelease") extern int32_t HAKO_ContextPoolRelease(HakoContextPool* pool, JSContext* ctx);
+
+//! Gets the number of idle contexts in a pool
+//! @param pool Pool
+//! @return Idle context count
+HAKO_EXPORT("HAKO_ContextPoolIdleCount") extern int32_t HAKO_ContextPoolIdleCount(HakoContextPool* pool);
+
+//! Prepares a fully initialized runtime to be captured as an image. An
+//! image is a byte copy of the whole linear memory plus the value of the
+//! exported __stack_pointer global, taken by the host after this call
+//! returns. To start from an image, instantiate the same module, skip
+//! _initialize, copy the image over the memory, restore __stack_pointer and
+//! call HAKO_RuntimeImageResume. Pointers stay valid because they are
+//! offsets into the memory. Host-side state such as registered function ids
+//! is not part of the image and must be recreated identically.
+//! @param rt Runtime, not running any JavaScript
+//! @return 0 on success, -1 if JavaScript is on the stack
+HAKO_EXPORT("HAKO_RuntimeImagePrepare") extern int32_t HAKO_RuntimeImagePrepare(JSRuntime* rt);
+
+//! Refreshes per-instance state after a runtime image was restored: the
+//! Math.random() seed and the performance time origin of every context
+//! @param rt Runtime from the restored image
+//! @return 0 on success, -1 on failure
+HAKO_EXPORT("HAKO_RuntimeImageResume") extern int32_t HAKO_RuntimeImageResume(JSRuntime* rt);
+
+//! Sets the fuel of a context. Fuel is counted in interrupt poll ticks
+//! (loop iterations and calls), so it is deterministic for a given program.
+//! A tick that finds no fuel left throws an uncatchable InternalError
+//! "out of fuel", and so does every further tick until fuel is added,
+//! including ticks in host calls such as converting the error to a string.
+//! Calling this again refills.
+//! @param ctx Context
+//! @param fuel Fuel in ticks, or -1 to disable metering
+HAKO_EXPORT("HAKO_SetFuel") extern void HAKO_SetFuel(JSContext* ctx, int64_t fuel);
+
+//! Gets the remaining fuel of a context
+//! @param ctx Context
+//! @return Remaining fuel in ticks, or -1 if metering is disabled
+HAKO_EXPORT("HAKO_GetFuel") extern int64_t HAKO_GetFuel(JSContext* ctx);
+
+//! Gets the total fuel consumed by a context, counted whether or not
+//! metering is enabled
+//! @param ctx Context
+//! @return Consumed ticks since the context was created
+HAKO_EXPORT("HAKO_GetFuelUsed") extern int64_t HAKO_GetFuelUsed(JSContext* ctx);
+
+//! Gets the fuel consumed by the most recent HAKO_Eval, HAKO_Call,
+//! HAKO_HandleCall, HAKO_CallDecode or HAKO_HandleCallDecode on the context,
+//! including nested calls made from host functions
+//! @param ctx Context
+//! @return Consumed ticks
+HAKO_EXPORT("HAKO_GetLastCallFuel") extern int64_t HAKO_GetLastCallFuel(JSContext* ctx);
+
+//! Sets the memory limits of a context in a runtime created with
+//! HAKO_RUNTIME_CONTEXT_MEMORY. Allocations that would take the context
+//! past the hard limit fail with an out of memory error. Crossing the soft
+//! limit makes the context's next interrupt poll call the interrupt
+//! handler, which can interrupt to throttle it.
+//! @param ctx Context
+//! @param soft_limit Soft limit in bytes, 0 for none
+//! @param hard_limit Hard limit in bytes, 0 for none
+//! @return 0 on success, -1 if the runtime does not account per context
+HAKO_EXPORT("HAKO_ContextSetMemoryLimits") extern int32_t HAKO_ContextSetMemoryLimits(JSContext* ctx, int64_t soft_limit, int64_t hard_limit);
+
+//! Gets the memory charged to a context in O(1). Strings and objects the
+//! context creates are charged to it; atoms, shapes and other blocks
+//! allocated on behalf of the whole runtime are not.
+//! @param ctx Context
+//! @param out Output usage. Host owns.
+//! @return 0 on success, -1 if the runtime does not account per context
+HAKO_EXPORT("HAKO_ContextGetMemoryUsage") extern int32_t HAKO_ContextGetMemoryUsage(JSContext* ctx, HakoContextMemoryUsage* out);
+
+//! Enables or disables the module bytecode cache of a runtime. Modules
+//! the module loader compiles from source are stored as bytecode keyed by
+//! module name, source text and strip flags; later imports of the same
+//! source from any context of the runtime skip parsing. Disabling
+//! drops the cached bytecode; the counters are kept.
+//! @param rt Runtime to configure
+//! @param enabled True to enable
+HAKO_EXPORT("HAKO_RuntimeEnableModuleCache") extern void HAKO_RuntimeEnableModuleCache(JSRuntime* rt, JS_BOOL enabled);
+
+//! Drops all cached module bytecode
+//! @param rt Runtime
+HAKO_EXPORT("HAKO_ModuleCacheClear") extern void HAKO_ModuleCacheClear(JSRuntime* rt);
+
+//! Gets module cache counters
+//! @param rt Runtime
+//! @param out Output counters. Host owns.
+HAKO_EXPORT("HAKO_ModuleCacheGetStats") extern void HAKO_ModuleCacheGetStats(JSRuntime* rt, HakoModuleCacheStats* out);
+
+//! Enables the asynchronous module loader. import() no longer blocks on
+//! the load_module import: the host fetch_module import is called with a
+//! token for each module of the import graph that is not loaded yet, all
+//! before any of them has to arrive, and the host answers each one later
+//! with HAKO_CompleteModuleFetch. The root module is evaluated once its
+//! whole static graph is compiled. Module names are normalized as by the
+//! module loader. Import attributes are not passed to fetch_module.
+//! @param rt Runtime to configure
+//! @param opaque User data passed to host fetch function. Host borrows.
+HAKO_EXPORT("HAKO_RuntimeEnableAsyncModuleLoader") extern void HAKO_RuntimeEnableAsyncModuleLoader(JSRuntime* rt, void* opaque);
+
+//! Disables the asynchronous module loader; import() loads synchronously
+//! again. Loads already started still complete.
+//! @param rt Runtime to configure
+HAKO_EXPORT("HAKO_RuntimeDisableAsyncModuleLoader") extern void HAKO_RuntimeDisableAsyncModuleLoader(JSRuntime* rt);
+
+//! Loads and evaluates a module graph through the host fetch function,
+//! like import() does with the asynchronous module loader
+//! @param ctx Context
+//! @param base_name Name of the importing module, or NULL
+//! @param specifier Module specifier
+//! @return Promise of the module namespace. Caller owns.
+HAKO_EXPORT("HAKO_LoadModuleAsync") extern JSValue* HAKO_LoadModuleAsync(JSContext* ctx, const char* base_name, const char* specifier);
+
+//! Completes a fetch started by the host fetch function. Sources are
+//! compiled (through the module cache when enabled) as soon as they
+//! arrive and their own imports are fetched in turn. An error or a
+//! compile failure rejects every pending load whose graph contains the
+//! module. May be called from within the fetch function.
+//! @param ctx Context the fetch was started in
+//! @param token Token passed to the fetch function
+//! @param kind What data holds
+//! @param data Source, bytecode or error message. Host owns.
+//! @param length Length of data in bytes
+//! @return 0 on success, -1 if the token is unknown or the loader was reset meanwhile (e.g. the context was returned to its pool)
+HAKO_EXPORT("HAKO_CompleteModuleFetch") extern int32_t HAKO_CompleteModuleFetch(JSContext* ctx, uint32_t token, HakoModuleFetchResult kind, const void* data, size_t length);
+
+//! Gets the number of asynchronous loads waiting for modules
+//! @param ctx Context
+//! @return Pending load count
+HAKO_EXPORT("HAKO_PendingModuleLoadCount") extern int32_t HAKO_PendingModuleLoadCount(JSContext* ctx);
+
+//! Lists the static imports and re-exports of module source without
+//! compiling it. Only the tokenizer runs, so it is much cheaper than a
+//! compile, but the result is a hint rather than a guarantee. With it a
+//! host can discover a whole import graph, fetch it in one batch and
+//! compile the modules concurrently in other instances with
+//! HAKO_CompileToByteCode and JS_EVAL_FLAG_NO_RESOLVE, then hand the
+//! bytecode to HAKO_CompleteModuleFetch or HAKO_EvalByteCode with
+//! load_only so the entry links without loading anything. The
+//! asynchronous module loader does the same scan to fetch the imports of
+//! a module before compiling it.
+//! @param ctx Context
+//! @param source Module source, NUL terminated. Host owns.
+//! @param source_len Source length in bytes
+//! @param module_name Name of the module, used to normalize the specifiers. Host owns.
+//! @param out_count Output number of names
+//! @return Normalized module names as consecutive NUL terminated strings, or NULL on error. Caller owns, free with HAKO_Free.
+HAKO_EXPORT("HAKO_ScanModuleImports") extern char* HAKO_ScanModuleImports(JSContext* ctx, const char* source, size_t source_len, const char* module_name, uint32_t* out_count);
+
+//! Enables lazy function compilation for code compiled afterwards.
+//! Strict mode functions with a simple parameter list, in strict code,
+//! are only parsed and get their variables resolved: the bytecode is
+//! generated by their first call, so the functions of a large bundle
+//! that never run cost less compile time and little memory. Syntax
+//! errors are still reported by the compile. Needs the function source,
+//! so it has no effect with HAKO_SetStripInfo stripping it.
+//! @param rt Runtime to configure
+//! @param enabled True to enable
+HAKO_EXPORT("HAKO_RuntimeEnableLazyFunctions") extern void HAKO_RuntimeEnableLazyFunctions(JSRuntime* rt, JS_BOOL enabled);
+
+//! Gets lazy function compilation counters
+//! @param rt Runtime
+//! @param out Output counters. Host owns.
+HAKO_EXPORT("HAKO_LazyFunctionGetStats") extern void HAKO_LazyFunctionGetStats(JSRuntime* rt, HakoLazyFunctionStats* out);
+
 #ifdef __cplusplus
 }
 #endif
@@ -307,6 +307,7 @@ void help(void)
            "    --no-unhandled-rejection  ignore unhandled promise rejections\n"
            "-s                    strip all the debug info\n"
            "    --strip-source    strip the source code\n"
+           "    --lazy-functions  compile the strict mode function bodies on their first call\n"
            "-q  --quit         just instantiate the interpreter and quit\n");
     exit(1);
 }
@@ -331,6 +332,7 @@ int main(int argc, char **argv)
     int i, include_count = 0;
     int strip_flags = 0;
     size_t stack_size = 0;
+    int lazy_functions = 0;
 
     /* cannot use getopt because we want to pass the command line to
        the script */
@@ -441,6 +443,10 @@ int main(int argc, char **argv)
                 strip_flags = JS_STRIP_SOURCE;
                 continue;
             }
+            if (!strcmp(longopt, "lazy-functions")) {
+                lazy_functions = 1;
+                continue;
+            }
             if (opt) {
                 fprintf(stderr, "qjs: unknown option '-%c'\n", opt);
             } else {
@@ -465,6 +471,7 @@ int main(int argc, char **argv)
     if (stack_size != 0)
         JS_SetMaxStackSize(rt, stack_size);
     JS_SetStripInfo(rt, strip_flags);
+    JS_SetLazyFunctions(rt, lazy_functions);
     js_std_set_worker_new_context_func(JS_NewCustomContext);
     js_std_init_handlers(rt);
     ctx = JS_NewCustomContext(rt);
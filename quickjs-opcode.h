@@ -358,6 +358,27 @@ DEF(   is_undefined, 1, 1, 1, none)
 DEF(        is_null, 1, 1, 1, none)
 DEF(typeof_is_undefined, 1, 1, 1, none)
 DEF( typeof_is_function, 1, 1, 1, none)
+
+/* superinstructions: comparison followed by if_false8. Must be in the
+   same order as lt, lte, gt, gte and strict_eq, strict_neq */
+DEF(   lt_if_false8, 2, 2, 0, label8)
+DEF(  lte_if_false8, 2, 2, 0, label8)
+DEF(   gt_if_false8, 2, 2, 0, label8)
+DEF(  gte_if_false8, 2, 2, 0, label8)
+DEF(strict_eq_if_false8, 2, 2, 0, label8)
+DEF(strict_neq_if_false8, 2, 2, 0, label8)
+
+/* only created at run time from get_field, get_field2 and put_field:
+   the operand is the index of the inline cache slot holding the atom */
+DEF(   get_field_ic, 5, 1, 1, u32)
+DEF(  get_field2_ic, 5, 1, 2, u32)
+DEF(   put_field_ic, 5, 2, 0, u32)
+
+/* only created at run time from add, sub and mul when float64 operands
+   are seen. Restored to the generic opcode for other operands */
+DEF(        add_f64, 1, 2, 1, none)
+DEF(        sub_f64, 1, 2, 1, none)
+DEF(        mul_f64, 1, 2, 1, none)
 #endif
 
 #undef DEF
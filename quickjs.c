@@ -78,6 +78,21 @@
 #define CONFIG_STACK_CHECK
 #endif
 
+/* define to cache the property location of the get_field, get_field2
+   and put_field instructions (see js_ic_rewrite()). Not enabled by
+   default as the shape lookup is about as fast for own properties. */
+//#define CONFIG_INLINE_CACHE
+
+/* define to run the calls from bytecode to bytecode functions in the
+   interpreter loop of the caller instead of recursing in
+   JS_CallInternal(). The recursion depth is then bounded by the stack
+   size limit instead of the native stack, which is small in the WASI
+   build. Not enabled on the other targets where the C recursion is
+   about as fast ('make CONFIG_INLINE_CALL=y test' checks it natively). */
+#if defined(__wasi__) && !defined(CONFIG_INLINE_CALL)
+#define CONFIG_INLINE_CALL
+#endif
+
 
 /* dump object free */
 //#define DUMP_FREE
@@ -108,6 +123,12 @@
 //#define DUMP_PROMISE
 //#define DUMP_READ_OBJECT
 //#define DUMP_ROPE_REBALANCE
+/* dump the most frequent executed opcodes, opcode pairs and triples
+   when freeing the runtime */
+//#define DUMP_OPCODE_PROFILE
+/* count the inline cache hits and misses (CONFIG_INLINE_CACHE) and
+   dump them when freeing the runtime */
+//#define DUMP_IC_STATS
 
 /* test the GC by forcing it before each object allocation */
 //#define FORCE_GC_AT_MALLOC
@@ -219,6 +240,8 @@ typedef enum JSErrorEnum {
 #define __exception __attribute__((warn_unused_result))
 
 typedef struct JSShape JSShape;
+typedef struct JSMemoryAccount JSMemoryAccount;
+typedef struct JSJobEntry JSJobEntry;
 typedef struct JSString JSString;
 typedef struct JSString JSAtomStruct;
 typedef struct JSObject JSObject;
@@ -238,6 +261,8 @@ typedef enum OPCodeEnum OPCodeEnum;
 struct JSRuntime {
     JSMallocFunctions mf;
     JSMallocState malloc_state;
+    /* if TRUE, every block starts with a JSAllocHeader */
+    BOOL context_accounting;
     const char *rt_info;
 
     int atom_hash_size; /* power of two */
@@ -276,14 +301,30 @@ struct JSRuntime {
     BOOL in_out_of_memory : 8;
 
     struct JSStackFrame *current_stack_frame;
+    /* frames of the bytecode functions called from the interpreter loop */
+    struct JSFrameChunk *frame_chunk; /* NULL if no frame was allocated */
+    struct JSFrameChunk *frame_chunk_free; /* kept to avoid reallocations */
+    size_t frame_stack_size; /* in bytes, used in the chunks below frame_chunk */
+#ifdef DUMP_OPCODE_PROFILE
+    struct JSOpProfile *op_profile;
+#endif
 
     JSInterruptHandler *interrupt_handler;
     void *interrupt_opaque;
+    /* ticks between two interrupt handler calls */
+    int interrupt_interval;
 
     JSHostPromiseRejectionTracker *host_promise_rejection_tracker;
     void *host_promise_rejection_tracker_opaque;
 
-    struct list_head job_list; /* list of JSJobEntry.link */
+    JSContextFinalizer *context_finalizer;
+
+    /* pending jobs in FIFO order: a ring buffer of job_size entries
+       (0 or a power of two) starting at job_head */
+    JSJobEntry *job_ring;
+    uint32_t job_head;
+    uint32_t job_count;
+    uint32_t job_size;
 
     JSModuleNormalizeFunc *module_normalize_func;
     BOOL module_loader_has_attr;
@@ -293,6 +334,9 @@ struct JSRuntime {
     } u;
     JSModuleCheckSupportedImportAttributes *module_check_attrs;
     void *module_loader_opaque;
+    /* may take over import() to load the module graph asynchronously */
+    JSModuleImportHook *module_import_hook;
+    void *module_import_opaque;
     /* timestamp for internal use in module evaluation */
     int64_t module_async_evaluation_next_timestamp;
 
@@ -301,6 +345,14 @@ struct JSRuntime {
     JSSharedArrayBufferFunctions sab_funcs;
     /* see JS_SetStripInfo() */
     uint8_t strip_flags;
+    /* see JS_SetLazyFunctions() */
+    BOOL lazy_functions : 8;
+    int64_t lazy_skipped_count;
+    int64_t lazy_compiled_count;
+#ifdef DUMP_IC_STATS
+    int64_t ic_hit_count;
+    int64_t ic_miss_count;
+#endif
     
     /* Shape hash table */
     int shape_hash_bits;
@@ -339,6 +391,48 @@ typedef struct JSStackFrame {
     JSValue *cur_sp;
 } JSStackFrame;
 
+/* A bytecode function called by OP_call or OP_call_method runs in the
+   JS_CallInternal() invocation of its caller. Its frame is allocated in
+   the runtime frame chunks and holds the state of the caller. */
+typedef struct JSInlineFrame {
+    JSStackFrame sf;
+    struct JSInlineFrame *prev; /* NULL if the caller is not inlined */
+    /* caller state which is not in its stack frame. Its stack frame is
+       sf.prev_frame and its pc is in cur_pc. */
+    JSValue *sp;
+    JSValue *local_buf;
+    JSValue this_obj;
+    JSValue *argv;
+    int argc;
+    int call_argc;
+    int call_opcode;
+    JSValue buf[0]; /* arguments, variables and stack of the callee */
+} JSInlineFrame;
+
+#define JS_FRAME_CHUNK_SIZE (64 * 1024)
+
+typedef struct JSFrameChunk {
+    struct JSFrameChunk *prev;
+    uint8_t *top; /* first free byte */
+    uint8_t *limit; /* end of the chunk or of the allowed frame stack size */
+    uint8_t *end;
+    JSValue buf[0];
+} JSFrameChunk;
+
+static uint8_t *js_frame_chunk_limit(JSRuntime *rt, JSFrameChunk *c)
+{
+    size_t avail;
+
+    if (rt->stack_size == 0)
+        return c->end;
+    if (rt->frame_stack_size >= rt->stack_size)
+        return (uint8_t *)c->buf;
+    avail = rt->stack_size - rt->frame_stack_size;
+    if (avail < (size_t)(c->end - (uint8_t *)c->buf))
+        return (uint8_t *)c->buf + avail;
+    return c->end;
+}
+
 typedef enum {
     JS_GC_OBJ_TYPE_JS_OBJECT,
     JS_GC_OBJ_TYPE_FUNCTION_BYTECODE,
@@ -481,6 +575,14 @@ struct JSContext {
 
     /* when the counter reaches zero, JSRutime.interrupt_handler is called */
     int interrupt_counter;
+    /* value interrupt_counter was last armed with */
+    int interrupt_counter_start;
+    /* remaining fuel in poll ticks, < 0 if unmetered */
+    int64_t fuel;
+    /* ticks consumed before the current counter period */
+    int64_t fuel_used;
+    /* allocations charged to this context, NULL if not accounted */
+    JSMemoryAccount *account;
 
     struct list_head loaded_modules; /* list of JSModuleDef.link */
 
@@ -643,6 +745,30 @@ typedef enum JSFunctionKindEnum {
     JS_FUNC_ASYNC_GENERATOR = (JS_FUNC_GENERATOR | JS_FUNC_ASYNC),
 } JSFunctionKindEnum;
 
+#define JS_IC_ENTRY_COUNT 4
+
+/* The shapes are referenced so that they cannot be modified in place:
+   a cached layout stays valid as long as the entry exists. */
+typedef struct JSInlineCacheEntry {
+    JSShape *shape; /* NULL if the entry is free */
+    /* shape of shape->proto if the property is found in the direct
+       prototype, NULL for an own property */
+    JSShape *proto_shape;
+    uint32_t prop_idx;
+} JSInlineCacheEntry;
+
+typedef struct JSInlineCacheSlot {
+    JSAtom atom;
+    uint8_t next_entry; /* entry replaced by the next miss */
+    JSInlineCacheEntry entries[JS_IC_ENTRY_COUNT];
+} JSInlineCacheSlot;
+
+typedef struct JSInlineCache {
+    uint32_t count;
+    uint32_t size;
+    JSInlineCacheSlot slots[0];
+} JSInlineCache;
+
 typedef struct JSFunctionBytecode {
     JSGCObjectHeader header; /* must come first */
     uint8_t js_mode;
@@ -659,7 +785,11 @@ typedef struct JSFunctionBytecode {
     uint8_t has_debug : 1;
     uint8_t read_only_bytecode : 1;
     uint8_t is_direct_or_indirect_eval : 1; /* used by JS_GetScriptOrModuleName() */
-    /* XXX: 10 bits available */
+    /* true if only the body source is kept: compiled on the first call,
+       the result is stored in cpool[0] */
+    uint8_t is_lazy : 1;
+    uint8_t lazy_func_expr : 1; /* is_func_expr of the lazy function */
+    /* XXX: 8 bits available */
     uint8_t *byte_code_buf; /* (self pointer) */
     int byte_code_len;
     JSAtom func_name;
@@ -673,6 +803,7 @@ typedef struct JSFunctionBytecode {
     JSValue *cpool; /* constant pool (self pointer) */
     int cpool_count;
     int closure_var_count;
+    JSInlineCache *ic; /* property access caches, allocated on demand */
     struct {
         /* debug info, move to separate structure to save memory? */
         JSAtom filename;
@@ -895,13 +1026,18 @@ struct JSModuleDef {
     JSValue private_value; /* private value for C modules */
 };
 
-typedef struct JSJobEntry {
-    struct list_head link;
+/* the built-in jobs take at most this many arguments */
+#define JS_JOB_INLINE_ARGS 5
+
+struct JSJobEntry {
     JSContext *realm;
     JSJobFunc *job_func;
     int argc;
-    JSValue argv[0];
-} JSJobEntry;
+    union {
+        JSValue argv[JS_JOB_INLINE_ARGS];
+        JSValue *heap_argv; /* if argc > JS_JOB_INLINE_ARGS */
+    } u;
+};
 
 typedef struct JSProperty {
     union {
@@ -1106,6 +1242,10 @@ static JSAtom __JS_NewAtomInit(JSRuntime *rt, const char *str, int len,
                                int atom_type);
 static void JS_FreeAtomStruct(JSRuntime *rt, JSAtomStruct *p);
 static void free_function_bytecode(JSRuntime *rt, JSFunctionBytecode *b);
+#ifdef DUMP_OPCODE_PROFILE
+static void js_dump_opcode_profile(JSRuntime *rt);
+#endif
+static JSFunctionBytecode *js_function_resolve_lazy(JSContext *ctx, JSObject *p);
 static JSValue js_call_c_function(JSContext *ctx, JSValueConst func_obj,
                                   JSValueConst this_obj,
                                   int argc, JSValueConst *argv, int flags);
@@ -1387,24 +1527,143 @@ static size_t js_malloc_usable_size_unknown(const void *ptr)
     return 0;
 }
 
+/* Per-context memory accounting. When enabled at runtime creation,
+   each block is prefixed with the account it is charged to, so frees
+   are credited to the right context wherever they happen. Blocks
+   allocated through the runtime functions are charged to no context. */
+struct JSMemoryAccount {
+    JSContext *ctx; /* NULL once the context is freed */
+    int64_t malloc_size;
+    int64_t malloc_count;
+    int64_t soft_limit; /* 0 if none */
+    int64_t hard_limit; /* 0 if none */
+};
+
+typedef union JSAllocHeader {
+    JSMemoryAccount *account;
+    uint64_t align;
+} JSAllocHeader;
+
+static void js_request_interrupt_poll(JSContext *ctx);
+
+static inline JSAllocHeader *js_alloc_header(const void *ptr)
+{
+    return (JSAllocHeader *)ptr - 1;
+}
+
+static inline int64_t js_alloc_block_size(JSRuntime *rt, JSAllocHeader *h)
+{
+    return rt->mf.js_malloc_usable_size(h) + MALLOC_OVERHEAD;
+}
+
+static BOOL js_account_can_grow(JSMemoryAccount *acc, size_t size)
+{
+    return !acc || !acc->hard_limit ||
+        acc->malloc_size + (int64_t)size <= acc->hard_limit;
+}
+
+static void js_account_add(JSMemoryAccount *acc, int64_t size)
+{
+    int64_t old_size = acc->malloc_size;
+    acc->malloc_size += size;
+    /* let the interrupt handler throttle a context crossing its soft limit */
+    if (acc->soft_limit && old_size <= acc->soft_limit &&
+        acc->malloc_size > acc->soft_limit && acc->ctx)
+        js_request_interrupt_poll(acc->ctx);
+}
+
+static void js_account_remove(JSRuntime *rt, JSMemoryAccount *acc, int64_t size)
+{
+    acc->malloc_size -= size;
+    if (--acc->malloc_count == 0 && !acc->ctx)
+        js_free_rt(rt, acc);
+}
+
+static void *js_malloc_account(JSRuntime *rt, JSMemoryAccount *acc, size_t size)
+{
+    JSAllocHeader *h;
+
+    if (!rt->context_accounting)
+        return rt->mf.js_malloc(&rt->malloc_state, size);
+    if (!js_account_can_grow(acc, size))
+        return NULL;
+    h = rt->mf.js_malloc(&rt->malloc_state, sizeof(*h) + size);
+    if (!h)
+        return NULL;
+    h->account = acc;
+    if (acc) {
+        acc->malloc_count++;
+        js_account_add(acc, js_alloc_block_size(rt, h));
+    }
+    return h + 1;
+}
+
+static void *js_realloc_account(JSRuntime *rt, JSMemoryAccount *acc,
+                                void *ptr, size_t size)
+{
+    JSAllocHeader *h;
+    int64_t old_size = 0, growth;
+
+    if (!rt->context_accounting)
+        return rt->mf.js_realloc(&rt->malloc_state, ptr, size);
+    if (!ptr) {
+        if (size == 0)
+            return NULL;
+        return js_malloc_account(rt, acc, size);
+    }
+    h = js_alloc_header(ptr);
+    /* a block stays charged to the context that allocated it */
+    acc = h->account;
+    if (size == 0) {
+        js_free_rt(rt, ptr);
+        return NULL;
+    }
+    if (acc) {
+        old_size = js_alloc_block_size(rt, h);
+        growth = (int64_t)(sizeof(*h) + size) - old_size;
+        if (growth > 0 && !js_account_can_grow(acc, growth))
+            return NULL;
+    }
+    h = rt->mf.js_realloc(&rt->malloc_state, h, sizeof(*h) + size);
+    if (!h)
+        return NULL;
+    if (acc)
+        js_account_add(acc, js_alloc_block_size(rt, h) - old_size);
+    return h + 1;
+}
+
 void *js_malloc_rt(JSRuntime *rt, size_t size)
 {
-    return rt->mf.js_malloc(&rt->malloc_state, size);
+    return js_malloc_account(rt, NULL, size);
 }
 
 void js_free_rt(JSRuntime *rt, void *ptr)
 {
-    rt->mf.js_free(&rt->malloc_state, ptr);
+    JSAllocHeader *h;
+
+    if (!rt->context_accounting || !ptr) {
+        rt->mf.js_free(&rt->malloc_state, ptr);
+        return;
+    }
+    h = js_alloc_header(ptr);
+    if (h->account)
+        js_account_remove(rt, h->account, js_alloc_block_size(rt, h));
+    rt->mf.js_free(&rt->malloc_state, h);
 }
 
 void *js_realloc_rt(JSRuntime *rt, void *ptr, size_t size)
 {
-    return rt->mf.js_realloc(&rt->malloc_state, ptr, size);
+    return js_realloc_account(rt, NULL, ptr, size);
 }
 
 size_t js_malloc_usable_size_rt(JSRuntime *rt, const void *ptr)
 {
-    return rt->mf.js_malloc_usable_size(ptr);
+    size_t size;
+
+    if (!rt->context_accounting)
+        return rt->mf.js_malloc_usable_size(ptr);
+    size = rt->mf.js_malloc_usable_size(js_alloc_header(ptr));
+    return size > sizeof(JSAllocHeader) ? size - sizeof(JSAllocHeader) : 0;
 }
 
 void *js_mallocz_rt(JSRuntime *rt, size_t size)
@@ -1420,7 +1679,7 @@ void *js_mallocz_rt(JSRuntime *rt, size_t size)
 void *js_malloc(JSContext *ctx, size_t size)
 {
     void *ptr;
-    ptr = js_malloc_rt(ctx->rt, size);
+    ptr = js_malloc_account(ctx->rt, ctx->account, size);
     if (unlikely(!ptr)) {
         JS_ThrowOutOfMemory(ctx);
         return NULL;
@@ -1432,12 +1691,10 @@ void *js_malloc(JSContext *ctx, size_t size)
 void *js_mallocz(JSContext *ctx, size_t size)
 {
     void *ptr;
-    ptr = js_mallocz_rt(ctx->rt, size);
-    if (unlikely(!ptr)) {
-        JS_ThrowOutOfMemory(ctx);
+    ptr = js_malloc(ctx, size);
+    if (unlikely(!ptr))
         return NULL;
-    }
-    return ptr;
+    return memset(ptr, 0, size);
 }
 
 void js_free(JSContext *ctx, void *ptr)
@@ -1449,7 +1706,7 @@ void js_free(JSContext *ctx, void *ptr)
 void *js_realloc(JSContext *ctx, void *ptr, size_t size)
 {
     void *ret;
-    ret = js_realloc_rt(ctx->rt, ptr, size);
+    ret = js_realloc_account(ctx->rt, ctx->account, ptr, size);
     if (unlikely(!ret && size != 0)) {
         JS_ThrowOutOfMemory(ctx);
         return NULL;
@@ -1461,7 +1718,7 @@ void *js_realloc(JSContext *ctx, void *ptr, size_t size)
 void *js_realloc2(JSContext *ctx, void *ptr, size_t size, size_t *pslack)
 {
     void *ret;
-    ret = js_realloc_rt(ctx->rt, ptr, size);
+    ret = js_realloc_account(ctx->rt, ctx->account, ptr, size);
     if (unlikely(!ret && size != 0)) {
         JS_ThrowOutOfMemory(ctx);
         return NULL;
@@ -1535,7 +1792,7 @@ static void *js_realloc_bytecode_rt(void *opaque, void *ptr, size_t size)
            avoid some overflows. */
         return NULL;
     } else {
-        return rt->mf.js_realloc(&rt->malloc_state, ptr, size);
+        return js_realloc_rt(rt, ptr, size);
     }
 }
 
@@ -1652,7 +1909,8 @@ static inline BOOL js_check_stack_overflow(JSRuntime *rt, size_t alloca_size)
 }
 #endif
 
-JSRuntime *JS_NewRuntime2(const JSMallocFunctions *mf, void *opaque)
+static JSRuntime *js_new_runtime(const JSMallocFunctions *mf, void *opaque,
+                                 BOOL context_accounting)
 {
     JSRuntime *rt;
     JSMallocState ms;
@@ -1672,6 +1930,8 @@ JSRuntime *JS_NewRuntime2(const JSMallocFunctions *mf, void *opaque)
     }
     rt->malloc_state = ms;
     rt->malloc_gc_threshold = 256 * 1024;
+    /* must be set before the first block is allocated */
+    rt->context_accounting = context_accounting;
 
     init_list_head(&rt->context_list);
     init_list_head(&rt->gc_obj_list);
@@ -1682,7 +1942,6 @@ JSRuntime *JS_NewRuntime2(const JSMallocFunctions *mf, void *opaque)
 #ifdef DUMP_LEAKS
     init_list_head(&rt->string_list);
 #endif
-    init_list_head(&rt->job_list);
 
     if (JS_InitAtoms(rt))
         goto fail;
@@ -1703,6 +1962,7 @@ JSRuntime *JS_NewRuntime2(const JSMallocFunctions *mf, void *opaque)
         goto fail;
 
     rt->stack_size = JS_DEFAULT_STACK_SIZE;
+    rt->interrupt_interval = JS_INTERRUPT_COUNTER_INIT;
     JS_UpdateStackTop(rt);
 
     rt->current_exception = JS_UNINITIALIZED;
@@ -1713,6 +1973,11 @@ JSRuntime *JS_NewRuntime2(const JSMallocFunctions *mf, void *opaque)
     return NULL;
 }
 
+JSRuntime *JS_NewRuntime2(const JSMallocFunctions *mf, void *opaque)
+{
+    return js_new_runtime(mf, opaque, FALSE);
+}
+
 void *JS_GetRuntimeOpaque(JSRuntime *rt)
 {
     return rt->user_opaque;
@@ -1810,6 +2075,11 @@ JSRuntime *JS_NewRuntime(void)
     return JS_NewRuntime2(&def_malloc_funcs, NULL);
 }
 
+JSRuntime *JS_NewRuntimeWithContextAccounting(void)
+{
+    return js_new_runtime(&def_malloc_funcs, NULL, TRUE);
+}
+
 void JS_SetMemoryLimit(JSRuntime *rt, size_t limit)
 {
     rt->malloc_state.malloc_limit = limit;
@@ -1852,30 +2122,86 @@ int JS_GetStripInfo(JSRuntime *rt)
     return rt->strip_flags;
 }
 
+static inline JSValue *js_job_argv(JSJobEntry *e)
+{
+    return e->argc > JS_JOB_INLINE_ARGS ? e->u.heap_argv : e->u.argv;
+}
+
+static void js_free_job_args(JSRuntime *rt, JSJobEntry *e)
+{
+    JSValue *argv = js_job_argv(e);
+    int i;
+
+    for(i = 0; i < e->argc; i++)
+        JS_FreeValueRT(rt, argv[i]);
+    if (argv != e->u.argv)
+        js_free_rt(rt, argv);
+}
+
+static int js_grow_job_ring(JSContext *ctx)
+{
+    JSRuntime *rt = ctx->rt;
+    JSJobEntry *ring;
+    uint32_t new_size, n;
+
+    new_size = max_int(rt->job_size * 2, 16);
+    ring = js_malloc_rt(rt, sizeof(ring[0]) * new_size);
+    if (!ring) {
+        JS_ThrowOutOfMemory(ctx);
+        return -1;
+    }
+    /* unwrap the entries to the start of the new buffer */
+    if (rt->job_count != 0) {
+        n = min_uint32(rt->job_count, rt->job_size - rt->job_head);
+        memcpy(ring, rt->job_ring + rt->job_head, sizeof(ring[0]) * n);
+        memcpy(ring + n, rt->job_ring, sizeof(ring[0]) * (rt->job_count - n));
+    }
+    js_free_rt(rt, rt->job_ring);
+    rt->job_ring = ring;
+    rt->job_head = 0;
+    rt->job_size = new_size;
+    return 0;
+}
+
 /* return 0 if OK, < 0 if exception */
 int JS_EnqueueJob(JSContext *ctx, JSJobFunc *job_func,
                   int argc, JSValueConst *argv)
 {
     JSRuntime *rt = ctx->rt;
     JSJobEntry *e;
+    JSValue *job_argv;
     int i;
 
-    e = js_malloc(ctx, sizeof(*e) + argc * sizeof(JSValue));
-    if (!e)
+    if (rt->job_count == rt->job_size && js_grow_job_ring(ctx))
         return -1;
+    e = &rt->job_ring[(rt->job_head + rt->job_count) & (rt->job_size - 1)];
+    if (argc > JS_JOB_INLINE_ARGS) {
+        e->u.heap_argv = js_malloc(ctx, sizeof(JSValue) * argc);
+        if (!e->u.heap_argv)
+            return -1;
+    }
     e->realm = JS_DupContext(ctx);
     e->job_func = job_func;
     e->argc = argc;
+    job_argv = js_job_argv(e);
     for(i = 0; i < argc; i++) {
-        e->argv[i] = JS_DupValue(ctx, argv[i]);
+        job_argv[i] = JS_DupValue(ctx, argv[i]);
     }
-    list_add_tail(&e->link, &rt->job_list);
+    rt->job_count++;
     return 0;
 }
 
 BOOL JS_IsJobPending(JSRuntime *rt)
 {
-    return !list_empty(&rt->job_list);
+    return rt->job_count != 0;
+}
+
+/* return the context of the next pending job or NULL if none */
+JSContext *JS_GetPendingJobContext(JSRuntime *rt)
+{
+    if (rt->job_count == 0)
+        return NULL;
+    return rt->job_ring[rt->job_head].realm;
 }
 
 /* return < 0 if exception, 0 if no job pending, 1 if a job was
@@ -1886,29 +2212,29 @@ BOOL JS_IsJobPending(JSRuntime *rt)
 int JS_ExecutePendingJob(JSRuntime *rt, JSContext **pctx)
 {
     JSContext *ctx;
-    JSJobEntry *e;
+    JSJobEntry e;
     JSValue res;
-    int i, ret;
+    int ret;
 
-    if (list_empty(&rt->job_list)) {
+    if (rt->job_count == 0) {
         if (pctx)
             *pctx = NULL;
         return 0;
     }
 
-    /* get the first pending job and execute it */
-    e = list_entry(rt->job_list.next, JSJobEntry, link);
-    list_del(&e->link);
-    ctx = e->realm;
-    res = e->job_func(ctx, e->argc, (JSValueConst *)e->argv);
-    for(i = 0; i < e->argc; i++)
-        JS_FreeValue(ctx, e->argv[i]);
+    /* take the first pending job out of the ring: the job may
+       enqueue new jobs and grow it */
+    e = rt->job_ring[rt->job_head];
+    rt->job_head = (rt->job_head + 1) & (rt->job_size - 1);
+    rt->job_count--;
+    ctx = e.realm;
+    res = e.job_func(ctx, e.argc, (JSValueConst *)js_job_argv(&e));
+    js_free_job_args(rt, &e);
     if (JS_IsException(res))
         ret = -1;
     else
         ret = 1;
     JS_FreeValue(ctx, res);
-    js_free(ctx, e);
     if (pctx) {
         if (ctx->header.ref_count > 1)
             *pctx = ctx;
@@ -1935,10 +2261,11 @@ static inline JSAtomStruct *atom_set_free(uint32_t v)
 }
 
 /* Note: the string contents are uninitialized */
-static JSString *js_alloc_string_rt(JSRuntime *rt, int max_len, int is_wide_char)
+static JSString *js_alloc_string_account(JSRuntime *rt, JSMemoryAccount *acc,
+                                         int max_len, int is_wide_char)
 {
     JSString *str;
-    str = js_malloc_rt(rt, sizeof(JSString) + (max_len << is_wide_char) + 1 - is_wide_char);
+    str = js_malloc_account(rt, acc, sizeof(JSString) + (max_len << is_wide_char) + 1 - is_wide_char);
     if (unlikely(!str))
         return NULL;
     str->header.ref_count = 1;
@@ -1953,10 +2280,15 @@ static JSString *js_alloc_string_rt(JSRuntime *rt, int max_len, int is_wide_char
     return str;
 }
 
+static JSString *js_alloc_string_rt(JSRuntime *rt, int max_len, int is_wide_char)
+{
+    return js_alloc_string_account(rt, NULL, max_len, is_wide_char);
+}
+
 static JSString *js_alloc_string(JSContext *ctx, int max_len, int is_wide_char)
 {
     JSString *p;
-    p = js_alloc_string_rt(ctx->rt, max_len, is_wide_char);
+    p = js_alloc_string_account(ctx->rt, ctx->account, max_len, is_wide_char);
     if (unlikely(!p)) {
         JS_ThrowOutOfMemory(ctx);
         return NULL;
@@ -1987,19 +2319,20 @@ void JS_SetRuntimeInfo(JSRuntime *rt, const char *s)
 
 void JS_FreeRuntime(JSRuntime *rt)
 {
-    struct list_head *el, *el1;
     int i;
 
     JS_FreeValueRT(rt, rt->current_exception);
 
-    list_for_each_safe(el, el1, &rt->job_list) {
-        JSJobEntry *e = list_entry(el, JSJobEntry, link);
-        for(i = 0; i < e->argc; i++)
-            JS_FreeValueRT(rt, e->argv[i]);
+    while (rt->job_count != 0) {
+        JSJobEntry *e = &rt->job_ring[rt->job_head];
+        rt->job_head = (rt->job_head + 1) & (rt->job_size - 1);
+        rt->job_count--;
+        js_free_job_args(rt, e);
         JS_FreeContext(e->realm);
-        js_free_rt(rt, e);
     }
-    init_list_head(&rt->job_list);
+    js_free_rt(rt, rt->job_ring);
+    rt->job_ring = NULL;
+    rt->job_size = 0;
 
     /* don't remove the weak objects to avoid create new jobs with
        FinalizationRegistry */
@@ -2127,6 +2460,19 @@ void JS_FreeRuntime(JSRuntime *rt)
     js_free_rt(rt, rt->atom_array);
     js_free_rt(rt, rt->atom_hash);
     js_free_rt(rt, rt->shape_hash);
+    /* the first frame chunk is kept when it is empty */
+    assert(!rt->frame_chunk || (!rt->frame_chunk->prev &&
+           rt->frame_chunk->top == (uint8_t *)rt->frame_chunk->buf));
+    js_free_rt(rt, rt->frame_chunk);
+    js_free_rt(rt, rt->frame_chunk_free);
+#ifdef DUMP_OPCODE_PROFILE
+    js_dump_opcode_profile(rt);
+    js_free_rt(rt, rt->op_profile);
+#endif
+#ifdef DUMP_IC_STATS
+    printf("inline caches: %" PRId64 " hits, %" PRId64 " misses\n",
+           rt->ic_hit_count, rt->ic_miss_count);
+#endif
 #ifdef DUMP_LEAKS
     if (!list_empty(&rt->string_list)) {
         if (rt->rt_info) {
@@ -2183,10 +2529,21 @@ JSContext *JS_NewContextRaw(JSRuntime *rt)
         return NULL;
     ctx->header.ref_count = 1;
     add_gc_object(rt, &ctx->header, JS_GC_OBJ_TYPE_JS_CONTEXT);
+    ctx->fuel = -1;
+    if (rt->context_accounting) {
+        ctx->account = js_mallocz_rt(rt, sizeof(*ctx->account));
+        if (!ctx->account) {
+            remove_gc_object(&ctx->header);
+            js_free_rt(rt, ctx);
+            return NULL;
+        }
+        ctx->account->ctx = ctx;
+    }
 
     ctx->class_proto = js_malloc_rt(rt, sizeof(ctx->class_proto[0]) *
                                     rt->class_count);
     if (!ctx->class_proto) {
+        js_free_rt(rt, ctx->account);
         js_free_rt(rt, ctx);
         return NULL;
     }
@@ -2244,6 +2601,11 @@ void JS_SetContextOpaque(JSContext *ctx, void *opaque)
     ctx->user_opaque = opaque;
 }
 
+void JS_SetContextFinalizer(JSRuntime *rt, JSContextFinalizer *finalizer)
+{
+    rt->context_finalizer = finalizer;
+}
+
 /* set the new value and free the old value after (freeing the value
    can reallocate the object data) */
 static inline void set_value(JSContext *ctx, JSValue *pval, JSValue new_val)
@@ -2344,6 +2706,9 @@ void JS_FreeContext(JSContext *ctx)
         return;
     assert(ctx->header.ref_count == 0);
 
+    if (rt->context_finalizer)
+        rt->context_finalizer(ctx);
+
 #ifdef DUMP_ATOMS
     JS_DumpAtoms(ctx->rt);
 #endif
@@ -2399,6 +2764,12 @@ void JS_FreeContext(JSContext *ctx)
 
     list_del(&ctx->link);
     remove_gc_object(&ctx->header);
+    if (ctx->account) {
+        /* blocks still alive keep the account until they are freed */
+        ctx->account->ctx = NULL;
+        if (ctx->account->malloc_count == 0)
+            js_free_rt(rt, ctx->account);
+    }
     js_free_rt(ctx->rt, ctx);
 }
 
@@ -2414,6 +2785,8 @@ static void update_stack_limit(JSRuntime *rt)
     } else {
         rt->stack_limit = rt->stack_top - rt->stack_size;
     }
+    if (rt->frame_chunk)
+        rt->frame_chunk->limit = js_frame_chunk_limit(rt, rt->frame_chunk);
 }
 
 void JS_SetMaxStackSize(JSRuntime *rt, size_t stack_size)
@@ -4919,6 +5292,39 @@ static void js_free_shape_null(JSRuntime *rt, JSShape *sh)
         js_free_shape(rt, sh);
 }
 
+static void js_inline_cache_free(JSRuntime *rt, JSInlineCache *ic)
+{
+    JSInlineCacheSlot *slot;
+    uint32_t i, j;
+
+    for(i = 0; i < ic->count; i++) {
+        slot = &ic->slots[i];
+        JS_FreeAtomRT(rt, slot->atom);
+        for(j = 0; j < JS_IC_ENTRY_COUNT; j++) {
+            js_free_shape_null(rt, slot->entries[j].shape);
+            js_free_shape_null(rt, slot->entries[j].proto_shape);
+        }
+    }
+    js_free_rt(rt, ic);
+}
+
+static void js_inline_cache_mark(JSRuntime *rt, JSInlineCache *ic,
+                                 JS_MarkFunc *mark_func)
+{
+    JSInlineCacheEntry *e;
+    uint32_t i, j;
+
+    for(i = 0; i < ic->count; i++) {
+        for(j = 0; j < JS_IC_ENTRY_COUNT; j++) {
+            e = &ic->slots[i].entries[j];
+            if (e->shape)
+                mark_func(rt, &e->shape->header);
+            if (e->proto_shape)
+                mark_func(rt, &e->proto_shape->header);
+        }
+    }
+}
+
 /* make space to hold at least 'count' properties */
 static no_inline int resize_properties(JSContext *ctx, JSShape **psh,
                                        JSObject *p, uint32_t count)
@@ -6176,6 +6582,8 @@ static void mark_children(JSRuntime *rt, JSGCObjectHeader *gp,
             for(i = 0; i < b->cpool_count; i++) {
                 JS_MarkValue(rt, b->cpool[i], mark_func);
             }
+            if (b->ic)
+                js_inline_cache_mark(rt, b->ic, mark_func);
             if (b->realm)
                 mark_func(rt, &b->realm->header);
         }
@@ -6450,6 +6858,10 @@ static void compute_bytecode_size(JSFunctionBytecode *b, JSMemoryUsage_helper *h
     if (!b->read_only_bytecode && b->byte_code_buf) {
         hp->js_func_code_size += b->byte_code_len;
     }
+    if (b->ic) {
+        memory_used_count++;
+        js_func_size += sizeof(*b->ic) + b->ic->size * sizeof(b->ic->slots[0]);
+    }
     if (b->has_debug) {
         js_func_size += sizeof(*b) - offsetof(JSFunctionBytecode, debug);
         if (b->debug.source) {
@@ -7401,10 +7813,52 @@ static void JS_ThrowInterrupted(JSContext *ctx)
     JS_SetUncatchableException(ctx, TRUE);
 }
 
+static void JS_ThrowOutOfFuel(JSContext *ctx)
+{
+    JS_ThrowInternalError(ctx, "out of fuel");
+    JS_SetUncatchableException(ctx, TRUE);
+}
+
+/* account the ticks run since the counter was armed. Returns -1 if the
+   last tick found no fuel left; that tick is not counted. */
+static int js_fuel_sync(JSContext *ctx)
+{
+    int64_t ticks = ctx->interrupt_counter_start - ctx->interrupt_counter;
+    int ret = 0;
+
+    ctx->fuel_used += ticks;
+    if (ctx->fuel >= 0) {
+        ctx->fuel -= ticks;
+        if (ctx->fuel < 0) {
+            ctx->fuel_used += ctx->fuel;
+            ctx->fuel = 0;
+            ret = -1;
+        }
+    }
+    ctx->interrupt_counter_start = ctx->interrupt_counter;
+    return ret;
+}
+
+/* the counter never runs more than one tick past the remaining fuel, so
+   exhaustion is detected on the exact tick */
+static void js_fuel_arm(JSContext *ctx)
+{
+    int n = ctx->rt->interrupt_interval;
+    if (ctx->fuel >= 0 && ctx->fuel < n)
+        n = ctx->fuel + 1;
+    ctx->interrupt_counter = n;
+    ctx->interrupt_counter_start = n;
+}
+
 static no_inline __exception int __js_poll_interrupts(JSContext *ctx)
 {
     JSRuntime *rt = ctx->rt;
-    ctx->interrupt_counter = JS_INTERRUPT_COUNTER_INIT;
+    int ret = js_fuel_sync(ctx);
+    js_fuel_arm(ctx);
+    if (ret < 0) {
+        JS_ThrowOutOfFuel(ctx);
+        return -1;
+    }
     if (rt->interrupt_handler) {
         if (rt->interrupt_handler(rt, ctx, rt->interrupt_opaque)) {
             JS_ThrowInterrupted(ctx);
@@ -16742,6 +17196,11 @@ static JSVarRef *js_closure_define_global_var(JSContext *ctx, JSClosureVar *cv,
     return var_ref;
 }
 
+/* Global variables are resolved once per closure: the var_refs[] entry
+   is shared with the global object (or global_var_obj) property, so
+   OP_get_var and OP_put_var need no lookup and no invalidation. Only the
+   bindings which are not references (accessors, properties inherited by
+   the global object or missing variables) use the property lookup. */
 static JSVarRef *js_closure_global_var(JSContext *ctx, JSClosureVar *cv)
 {
     JSObject *p;
@@ -17238,6 +17697,364 @@ static JSValue js_call_bound_function(JSContext *ctx, JSValueConst func_obj,
     }
 }
 
+#ifdef DUMP_IC_STATS
+#define IC_STAT(rt, field) ((rt)->field++)
+#else
+#define IC_STAT(rt, field) ((void)0)
+#endif
+
+#if SHORT_OPCODES
+#ifdef CONFIG_INLINE_CACHE
+/* Replace the get_field, get_field2 or put_field instruction at 'pc' by
+   its inline cached version 'ic_op'. Return FALSE if not possible. */
+static BOOL js_ic_rewrite(JSRuntime *rt, JSFunctionBytecode *b,
+                          uint8_t *pc, int ic_op)
+{
+    JSInlineCache *ic;
+    JSInlineCacheSlot *slot;
+    uint32_t new_size;
+
+    if (b->read_only_bytecode)
+        return FALSE;
+    ic = b->ic;
+    if (!ic || ic->count >= ic->size) {
+        new_size = ic ? ic->size * 2 : 4;
+        ic = js_realloc_rt(rt, ic, sizeof(*ic) +
+                           new_size * sizeof(ic->slots[0]));
+        if (!ic)
+            return FALSE;
+        if (!b->ic)
+            ic->count = 0;
+        ic->size = new_size;
+        b->ic = ic;
+    }
+    slot = &ic->slots[ic->count];
+    memset(slot, 0, sizeof(*slot));
+    /* the atom reference is transferred to the slot */
+    slot->atom = get_u32(pc + 1);
+    put_u32(pc + 1, ic->count++);
+    pc[0] = ic_op;
+    return TRUE;
+}
+
+/* The property of 'p' was found in 'holder' by the get_field,
+   get_field2 or put_field instruction ending at 'pc'. Only the
+   instructions whose property may be cached are rewritten so that the
+   other ones keep the generic lookup. */
+static inline void js_ic_rewrite_found(JSRuntime *rt, JSFunctionBytecode *b,
+                                       const uint8_t *pc, int ic_op,
+                                       JSObject *p, JSObject *holder)
+{
+    /* the unhashed shapes are not cached */
+    if (p->shape->is_hashed && holder->shape->is_hashed &&
+        (holder == p || holder == p->shape->proto))
+        js_ic_rewrite(rt, b, (uint8_t *)pc - 5, ic_op);
+}
+#endif /* CONFIG_INLINE_CACHE */
+
+/* Quickening: replace the opcode before 'pc' by its specialized
+   version 'op'. The read-only bytecode always uses the generic
+   opcodes. */
+static inline void js_quicken(JSFunctionBytecode *b, const uint8_t *pc,
+                              int op)
+{
+    if (!b->read_only_bytecode)
+        ((uint8_t *)pc)[-1] = op;
+}
+
+/* return TRUE if 'op1' and 'op2' are numbers and at least one of them
+   is a float64. Their values are stored in 'pd1' and 'pd2'. */
+static inline BOOL js_get_float64_operands(JSValueConst op1, JSValueConst op2,
+                                           double *pd1, double *pd2)
+{
+    uint32_t tag1, tag2;
+
+    tag1 = JS_VALUE_GET_NORM_TAG(op1);
+    tag2 = JS_VALUE_GET_NORM_TAG(op2);
+    if (tag1 == JS_TAG_FLOAT64) {
+        *pd1 = JS_VALUE_GET_FLOAT64(op1);
+        if (tag2 == JS_TAG_FLOAT64)
+            *pd2 = JS_VALUE_GET_FLOAT64(op2);
+        else if (tag2 == JS_TAG_INT)
+            *pd2 = JS_VALUE_GET_INT(op2);
+        else
+            return FALSE;
+    } else if (tag1 == JS_TAG_INT && tag2 == JS_TAG_FLOAT64) {
+        *pd1 = JS_VALUE_GET_INT(op1);
+        *pd2 = JS_VALUE_GET_FLOAT64(op2);
+    } else {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* return the cached property of 'p' or NULL */
+static inline JSProperty *js_ic_find(JSInlineCacheSlot *slot, JSObject *p)
+{
+    JSShape *sh = p->shape;
+    JSInlineCacheEntry *e;
+    JSObject *holder;
+    int i;
+
+    e = &slot->entries[0];
+    if (unlikely(e->shape != sh)) {
+        /* the entries are filled in order */
+        for(i = 1; i < JS_IC_ENTRY_COUNT; i++) {
+            e = &slot->entries[i];
+            if (e->shape == sh)
+                break;
+            if (!e->shape)
+                return NULL;
+        }
+        if (i == JS_IC_ENTRY_COUNT)
+            return NULL;
+    }
+    if (!e->proto_shape)
+        return &p->prop[e->prop_idx];
+    /* an exotic object may have the property without having it in
+       its shape */
+    holder = sh->proto;
+    if (unlikely(holder->shape != e->proto_shape || p->is_exotic))
+        return NULL;
+    return &holder->prop[e->prop_idx];
+}
+
+static void js_ic_add(JSRuntime *rt, JSInlineCacheSlot *slot, JSShape *sh,
+                      JSShape *proto_sh, uint32_t prop_idx)
+{
+    JSInlineCacheEntry *e;
+    JSShape *old_sh, *old_proto_sh;
+    int i;
+
+    /* the unhashed shapes are modified in place */
+    if (!sh->is_hashed || (proto_sh && !proto_sh->is_hashed))
+        return;
+    for(i = 0; i < JS_IC_ENTRY_COUNT; i++) {
+        if (slot->entries[i].shape == sh)
+            break;
+    }
+    if (i == JS_IC_ENTRY_COUNT) {
+        i = slot->next_entry;
+        slot->next_entry = (i + 1) % JS_IC_ENTRY_COUNT;
+    }
+    e = &slot->entries[i];
+    old_sh = e->shape;
+    old_proto_sh = e->proto_shape;
+    e->shape = js_dup_shape(sh);
+    e->proto_shape = proto_sh ? js_dup_shape(proto_sh) : NULL;
+    e->prop_idx = prop_idx;
+    js_free_shape_null(rt, old_sh);
+    js_free_shape_null(rt, old_proto_sh);
+}
+
+/* Same lookup as JS_GetPropertyInternal(). The plain data properties
+   are returned without a second lookup. */
+static JSValue js_ic_get_field_miss(JSContext *ctx, JSInlineCacheSlot *slot,
+                                    JSValueConst obj)
+{
+    JSAtom atom = slot->atom;
+    JSObject *p, *p1;
+    JSShapeProperty *prs;
+    JSProperty *pr;
+    int depth;
+
+    IC_STAT(ctx->rt, ic_miss_count);
+    if (JS_VALUE_GET_TAG(obj) == JS_TAG_OBJECT) {
+        p = JS_VALUE_GET_OBJ(obj);
+        p1 = p;
+        for(depth = 0;; depth++) {
+            prs = find_own_property(&pr, p1, atom);
+            if (prs) {
+                if (prs->flags & JS_PROP_TMASK)
+                    break;
+                if (depth == 0) {
+                    js_ic_add(ctx->rt, slot, p->shape, NULL,
+                              prs - get_shape_prop(p->shape));
+                } else if (depth == 1) {
+                    js_ic_add(ctx->rt, slot, p->shape, p1->shape,
+                              prs - get_shape_prop(p1->shape));
+                }
+                return JS_DupValue(ctx, pr->u.value);
+            }
+            if (p1->is_exotic)
+                break;
+            p1 = p1->shape->proto;
+            if (!p1)
+                return JS_UNDEFINED;
+        }
+    }
+    /* 'slot' may be reallocated by the getters */
+    return JS_GetPropertyInternal(ctx, obj, atom, obj, 0);
+}
+
+static int js_ic_put_field_miss(JSContext *ctx, JSInlineCacheSlot *slot,
+                                JSValueConst obj, JSValue val)
+{
+    JSAtom atom = slot->atom;
+    JSObject *p;
+    JSShapeProperty *prs;
+    JSProperty *pr;
+
+    IC_STAT(ctx->rt, ic_miss_count);
+    if (JS_VALUE_GET_TAG(obj) == JS_TAG_OBJECT) {
+        p = JS_VALUE_GET_OBJ(obj);
+        prs = find_own_property(&pr, p, atom);
+        if (prs && (prs->flags & (JS_PROP_TMASK | JS_PROP_WRITABLE |
+                                  JS_PROP_LENGTH)) == JS_PROP_WRITABLE) {
+            js_ic_add(ctx->rt, slot, p->shape, NULL,
+                      prs - get_shape_prop(p->shape));
+            set_value(ctx, &pr->u.value, val);
+            return TRUE;
+        }
+    }
+    return JS_SetPropertyInternal(ctx, obj, atom, val, obj,
+                                  JS_PROP_THROW_STRICT);
+}
+#endif /* SHORT_OPCODES */
+
+#ifdef DUMP_OPCODE_PROFILE
+#define OP_PROFILE_TRIPLE_HASH_BITS 16
+
+typedef struct JSOpProfileTriple {
+    uint32_t ops; /* op0 | (op1 << 8) | (op2 << 16) | (1 << 24) */
+    uint64_t count;
+} JSOpProfileTriple;
+
+/* dynamic opcode frequencies. The sequences continue across function
+   calls and returns as they are seen by the dispatcher. */
+typedef struct JSOpProfile {
+    int prev_op[2]; /* last two executed opcodes, -1 if none */
+    uint64_t total_count;
+    uint64_t lost_count; /* triples not counted because the hash table is full */
+    uint64_t op_count[256];
+    uint64_t pair_count[256][256];
+    JSOpProfileTriple triples[1 << OP_PROFILE_TRIPLE_HASH_BITS];
+} JSOpProfile;
+
+static int js_profile_opcode(JSRuntime *rt, int op)
+{
+    JSOpProfile *s = rt->op_profile;
+    uint32_t ops, h;
+
+    if (!s) {
+        s = js_mallocz_rt(rt, sizeof(*s));
+        if (!s)
+            return op;
+        s->prev_op[0] = s->prev_op[1] = -1;
+        rt->op_profile = s;
+    }
+    s->total_count++;
+    s->op_count[op]++;
+    if (s->prev_op[1] >= 0) {
+        s->pair_count[s->prev_op[1]][op]++;
+        if (s->prev_op[0] >= 0) {
+            ops = s->prev_op[0] | (s->prev_op[1] << 8) | (op << 16) | (1 << 24);
+            h = (ops * 0x9E3779B1) >> (32 - OP_PROFILE_TRIPLE_HASH_BITS);
+            for(;;) {
+                JSOpProfileTriple *t = &s->triples[h];
+                if (t->ops == ops) {
+                    t->count++;
+                    break;
+                }
+                if (t->ops == 0) {
+                    t->ops = ops;
+                    t->count = 1;
+                    break;
+                }
+                h = (h + 1) & ((1 << OP_PROFILE_TRIPLE_HASH_BITS) - 1);
+                if (h == ((ops * 0x9E3779B1) >> (32 - OP_PROFILE_TRIPLE_HASH_BITS))) {
+                    s->lost_count++;
+                    break;
+                }
+            }
+        }
+    }
+    s->prev_op[0] = s->prev_op[1];
+    s->prev_op[1] = op;
+    return op;
+}
+
+#define PROFILE_OPCODE(op) js_profile_opcode(rt, op)
+#else
+#define PROFILE_OPCODE(op) (op)
+#endif /* DUMP_OPCODE_PROFILE */
+
+/* TRUE if the interpreter can run 'func_obj' in the frame chunks */
+static inline BOOL js_is_inline_call(JSValueConst func_obj)
+{
+#ifdef CONFIG_INLINE_CALL
+    return JS_VALUE_GET_TAG(func_obj) == JS_TAG_OBJECT &&
+        JS_VALUE_GET_OBJ(func_obj)->class_id == JS_CLASS_BYTECODE_FUNCTION;
+#else
+    return FALSE;
+#endif
+}
+
+static no_inline JSInlineFrame *js_alloc_inline_frame_slow(JSContext *ctx,
+                                                          size_t size)
+{
+    JSRuntime *rt = ctx->rt;
+    JSFrameChunk *c = rt->frame_chunk;
+    size_t used, chunk_size;
+
+    used = rt->frame_stack_size;
+    if (c)
+        used += c->top - (uint8_t *)c->buf;
+    if (rt->stack_size != 0 && used + size > rt->stack_size) {
+        JS_ThrowStackOverflow(ctx);
+        return NULL;
+    }
+    c = rt->frame_chunk_free;
+    if (c && (size_t)(c->end - (uint8_t *)c->buf) >= size) {
+        rt->frame_chunk_free = NULL;
+    } else {
+        chunk_size = sizeof(JSFrameChunk) + size;
+        if (chunk_size < JS_FRAME_CHUNK_SIZE)
+            chunk_size = JS_FRAME_CHUNK_SIZE;
+        c = js_malloc(ctx, chunk_size);
+        if (!c)
+            return NULL;
+        c->end = (uint8_t *)c + chunk_size;
+    }
+    rt->frame_stack_size = used;
+    c->prev = rt->frame_chunk;
+    c->top = (uint8_t *)c->buf + size;
+    c->limit = js_frame_chunk_limit(rt, c);
+    rt->frame_chunk = c;
+    return (JSInlineFrame *)c->buf;
+}
+
+/* allocate the frame of an inlined call. The frames are released in
+   reverse order by js_free_inline_frame(). */
+static inline JSInlineFrame *js_alloc_inline_frame(JSContext *ctx, size_t size)
+{
+    JSFrameChunk *c = ctx->rt->frame_chunk;
+    JSInlineFrame *f;
+
+    if (unlikely(!c || (size_t)(c->limit - c->top) < size))
+        return js_alloc_inline_frame_slow(ctx, size);
+    f = (JSInlineFrame *)c->top;
+    c->top += size;
+    return f;
+}
+
+static inline void js_free_inline_frame(JSRuntime *rt, JSInlineFrame *f)
+{
+    JSFrameChunk *c = rt->frame_chunk;
+
+    c->top = (uint8_t *)f;
+    /* the first chunk stays allocated so that the calls made from a
+       C frame do not switch chunks */
+    if (unlikely(c->top == (uint8_t *)c->buf && c->prev)) {
+        rt->frame_chunk = c->prev;
+        rt->frame_stack_size -= c->prev->top - (uint8_t *)c->prev->buf;
+        c->prev->limit = js_frame_chunk_limit(rt, c->prev);
+        if (rt->frame_chunk_free)
+            js_free_rt(rt, rt->frame_chunk_free);
+        rt->frame_chunk_free = c;
+    }
+}
+
 /* argument of OP_special_object */
 typedef enum {
     OP_SPECIAL_OBJECT_ARGUMENTS,
@@ -17269,9 +18086,13 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
     JSValue *local_buf, *stack_buf, *var_buf, *arg_buf, *sp, ret_val, *pval;
     JSVarRef **var_refs;
     size_t alloca_size;
+    /* non NULL if 'b' is inlined. 'caller_ctx', 'func_obj' and
+       'new_target' then refer to the outermost function, which is the
+       only one that can be a constructor. */
+    JSInlineFrame *inline_frame = NULL;
 
 #if !DIRECT_DISPATCH
-#define SWITCH(pc)      switch (opcode = *pc++)
+#define SWITCH(pc)      switch (opcode = PROFILE_OPCODE(*pc++))
 #define CASE(op)        case op
 #define DEFAULT         default
 #define BREAK           break
@@ -17286,7 +18107,7 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
 #include "quickjs-opcode.h"
         [ OP_COUNT ... 255 ] = &&case_default
     };
-#define SWITCH(pc)      goto *dispatch_table[opcode = *pc++];
+#define SWITCH(pc)      goto *dispatch_table[opcode = PROFILE_OPCODE(*pc++)];
 #define CASE(op)        case_ ## op
 #define DEFAULT         case_default
 #define BREAK           SWITCH(pc)
@@ -17332,6 +18153,11 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                          (JSValueConst *)argv, flags);
     }
     b = p->u.func.function_bytecode;
+    if (unlikely(b->is_lazy)) {
+        b = js_function_resolve_lazy(caller_ctx, p);
+        if (!b)
+            return JS_EXCEPTION;
+    }
 
     if (unlikely(argc < b->arg_count || (flags & JS_CALL_FLAG_COPY_ARGV))) {
         arg_allocated_size = b->arg_count;
@@ -17379,6 +18205,7 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
     for(;;) {
         int call_argc;
         JSValue *call_argv;
+        JSValueConst call_this;
 
         SWITCH(pc) {
         CASE(OP_push_i32):
@@ -17487,12 +18314,15 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                     *sp++ = JS_DupValue(ctx, sf->cur_func);
                     break;
                 case OP_SPECIAL_OBJECT_NEW_TARGET:
-                    *sp++ = JS_DupValue(ctx, new_target);
+                    if (inline_frame)
+                        *sp++ = JS_UNDEFINED;
+                    else
+                        *sp++ = JS_DupValue(ctx, new_target);
                     break;
                 case OP_SPECIAL_OBJECT_HOME_OBJECT:
                     {
                         JSObject *p1;
-                        p1 = p->u.func.home_object;
+                        p1 = JS_VALUE_GET_OBJ(sf->cur_func)->u.func.home_object;
                         if (unlikely(!p1))
                             *sp++ = JS_UNDEFINED;
                         else
@@ -17693,6 +18523,13 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
             has_call_argc:
                 call_argv = sp - call_argc;
                 sf->cur_pc = pc;
+                if (js_is_inline_call(call_argv[-1])) {
+                    call_this = JS_UNDEFINED;
+                    if (opcode == OP_tail_call && inline_frame &&
+                        (b->js_mode & JS_MODE_STRICT))
+                        goto inline_tail_call;
+                    goto inline_call;
+                }
                 ret_val = JS_CallInternal(ctx, call_argv[-1], JS_UNDEFINED,
                                           JS_UNDEFINED, call_argc, call_argv, 0);
                 if (unlikely(JS_IsException(ret_val)))
@@ -17729,6 +18566,13 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                 pc += 2;
                 call_argv = sp - call_argc;
                 sf->cur_pc = pc;
+                if (js_is_inline_call(call_argv[-1])) {
+                    call_this = call_argv[-2];
+                    if (opcode == OP_tail_call_method && inline_frame &&
+                        (b->js_mode & JS_MODE_STRICT))
+                        goto inline_tail_call;
+                    goto inline_call;
+                }
                 ret_val = JS_CallInternal(ctx, call_argv[-1], call_argv[-2],
                                           JS_UNDEFINED, call_argc, call_argv, 0);
                 if (unlikely(JS_IsException(ret_val)))
@@ -17741,6 +18585,148 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                 *sp++ = ret_val;
             }
             BREAK;
+
+        inline_call:
+            /* run the callee in this loop without C recursion. The
+               caller state is saved in the callee frame and restored
+               when it returns. */
+            {
+                JSObject *p1 = JS_VALUE_GET_OBJ(call_argv[-1]);
+                JSFunctionBytecode *b1 = p1->u.func.function_bytecode;
+                JSInlineFrame *f;
+
+                if (unlikely(js_poll_interrupts(ctx)))
+                    goto exception;
+                if (unlikely(b1->is_lazy)) {
+                    b1 = js_function_resolve_lazy(ctx, p1);
+                    if (!b1)
+                        goto exception;
+                }
+                if (unlikely(call_argc < b1->arg_count))
+                    arg_allocated_size = b1->arg_count;
+                else
+                    arg_allocated_size = 0;
+                f = js_alloc_inline_frame(ctx, sizeof(JSInlineFrame) +
+                                          sizeof(JSValue) * (arg_allocated_size +
+                                                             b1->var_count +
+                                                             b1->stack_size));
+                if (unlikely(!f))
+                    goto exception;
+                f->prev = inline_frame;
+                f->sp = sp;
+                f->local_buf = local_buf;
+                f->this_obj = this_obj;
+                f->argv = argv;
+                f->argc = argc;
+                f->call_argc = call_argc;
+                f->call_opcode = opcode;
+                inline_frame = f;
+
+                ctx = b1->realm;
+                b = b1;
+                this_obj = call_this;
+                argc = call_argc;
+                argv = call_argv;
+                var_refs = p1->u.func.var_refs;
+
+                sf = &f->sf;
+                sf->js_mode = b->js_mode;
+                sf->arg_count = argc;
+                sf->cur_func = call_argv[-1];
+                init_list_head(&sf->var_ref_list);
+                local_buf = f->buf;
+                arg_buf = argv;
+                if (unlikely(arg_allocated_size)) {
+                    arg_buf = local_buf;
+                    for(i = 0; i < argc; i++)
+                        arg_buf[i] = JS_DupValue(ctx, argv[i]);
+                    for(; i < b->arg_count; i++)
+                        arg_buf[i] = JS_UNDEFINED;
+                    sf->arg_count = b->arg_count;
+                }
+                var_buf = local_buf + arg_allocated_size;
+                sf->var_buf = var_buf;
+                sf->arg_buf = arg_buf;
+                for(i = 0; i < b->var_count; i++)
+                    var_buf[i] = JS_UNDEFINED;
+                stack_buf = var_buf + b->var_count;
+                sp = stack_buf;
+                pc = b->byte_code_buf;
+                sf->prev_frame = rt->current_stack_frame;
+                rt->current_stack_frame = sf;
+            }
+            BREAK;
+
+        inline_tail_call:
+            /* strict mode tail call from an inlined frame: the callee
+               replaces the current function in the same frame, so
+               tail recursion runs in constant space. The frame holds
+               'this', the function and a copy of the arguments before
+               the variables and the stack. */
+            {
+                JSObject *p1 = JS_VALUE_GET_OBJ(call_argv[-1]);
+                JSFunctionBytecode *b1 = p1->u.func.function_bytecode;
+                JSInlineFrame *f = inline_frame;
+                JSFrameChunk *c = rt->frame_chunk;
+                JSValue call_func;
+                int n_args, n;
+                size_t size;
+
+                if (unlikely(js_poll_interrupts(ctx)))
+                    goto exception;
+                if (unlikely(b1->is_lazy)) {
+                    b1 = js_function_resolve_lazy(ctx, p1);
+                    if (!b1)
+                        goto exception;
+                }
+                n_args = max_int(call_argc, b1->arg_count);
+                size = sizeof(JSInlineFrame) +
+                    sizeof(JSValue) * (2 + n_args + b1->var_count +
+                                       b1->stack_size);
+                /* otherwise run it in a new frame */
+                if ((size_t)(c->limit - (uint8_t *)f) < size)
+                    goto inline_call;
+
+                /* release the current function state but keep the
+                   call values */
+                if (unlikely(!list_empty(&sf->var_ref_list)))
+                    close_var_refs(rt, sf);
+                n = (opcode == OP_tail_call_method) ? 2 : 1;
+                for(pval = local_buf; pval < call_argv - n; pval++)
+                    JS_FreeValue(ctx, *pval);
+                call_func = call_argv[-1];
+                if (opcode == OP_tail_call_method)
+                    call_this = call_argv[-2];
+                memmove(f->buf + 2, call_argv, sizeof(JSValue) * call_argc);
+                f->buf[0] = call_this;
+                f->buf[1] = call_func;
+                c->top = (uint8_t *)f + size;
+
+                ctx = b1->realm;
+                b = b1;
+                this_obj = call_this;
+                local_buf = f->buf;
+                arg_buf = local_buf + 2;
+                for(i = call_argc; i < n_args; i++)
+                    arg_buf[i] = JS_UNDEFINED;
+                argc = call_argc;
+                argv = arg_buf;
+                var_refs = p1->u.func.var_refs;
+
+                sf->js_mode = b->js_mode;
+                sf->arg_count = n_args;
+                sf->cur_func = call_func;
+                init_list_head(&sf->var_ref_list);
+                var_buf = arg_buf + n_args;
+                sf->var_buf = var_buf;
+                sf->arg_buf = arg_buf;
+                for(i = 0; i < b->var_count; i++)
+                    var_buf[i] = JS_UNDEFINED;
+                stack_buf = var_buf + b->var_count;
+                sp = stack_buf;
+                pc = b->byte_code_buf;
+            }
+            BREAK;
         CASE(OP_array_from):
             call_argc = get_u16(pc);
             pc += 2;
@@ -17789,7 +18775,7 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
             sp++;
             BREAK;
         CASE(OP_check_ctor):
-            if (JS_IsUndefined(new_target)) {
+            if (inline_frame || JS_IsUndefined(new_target)) {
             non_ctor_call:
                 JS_ThrowTypeError(ctx, "class constructors must be invoked with 'new'");
                 goto exception;
@@ -18601,7 +19587,16 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
             }
             BREAK;
 
-#define GET_FIELD_INLINE(name, keep, is_length)                         \
+#if SHORT_OPCODES && defined(CONFIG_INLINE_CACHE)
+#define IC_OP(op) (op)
+#define IC_REWRITE(ic_op, obj, holder) \
+    js_ic_rewrite_found(rt, b, pc, ic_op, JS_VALUE_GET_OBJ(obj), holder)
+#else
+#define IC_OP(op) 0
+#define IC_REWRITE(ic_op, obj, holder) ((void)0)
+#endif
+
+#define GET_FIELD_INLINE(name, keep, is_length, ic_op)                  \
             {                                                           \
                 JSValue val, obj;                                       \
                 JSAtom atom;                                            \
@@ -18626,6 +19621,8 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                             if (unlikely(prs->flags & JS_PROP_TMASK))   \
                                     goto name ## _slow_path;            \
                             val = JS_DupValue(ctx, pr->u.value);        \
+                            if (ic_op)                                  \
+                                IC_REWRITE(ic_op, obj, p);              \
                             break;                                      \
                         }                                               \
                         if (unlikely(p->is_exotic)) {                   \
@@ -18658,16 +19655,78 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
 
             
         CASE(OP_get_field):
-            GET_FIELD_INLINE(get_field, 0, 0);
+            GET_FIELD_INLINE(get_field, 0, 0, IC_OP(OP_get_field_ic));
             BREAK;
 
         CASE(OP_get_field2):
-            GET_FIELD_INLINE(get_field2, 1, 0);
+            GET_FIELD_INLINE(get_field2, 1, 0, IC_OP(OP_get_field2_ic));
             BREAK;
 
 #if SHORT_OPCODES
         CASE(OP_get_length):
-            GET_FIELD_INLINE(get_length, 0, 1);
+            GET_FIELD_INLINE(get_length, 0, 1, 0);
+            BREAK;
+
+#define GET_FIELD_IC(keep)                                              \
+            {                                                           \
+                JSValue val, obj;                                       \
+                JSInlineCacheSlot *slot;                                \
+                JSProperty *pr;                                         \
+                                                                        \
+                slot = &b->ic->slots[get_u32(pc)];                      \
+                pc += 4;                                                \
+                obj = sp[-1];                                           \
+                if (likely(JS_VALUE_GET_TAG(obj) == JS_TAG_OBJECT &&    \
+                           (pr = js_ic_find(slot, JS_VALUE_GET_OBJ(obj))))) { \
+                    IC_STAT(rt, ic_hit_count);                          \
+                    val = JS_DupValue(ctx, pr->u.value);                \
+                } else {                                                \
+                    sf->cur_pc = pc;                                    \
+                    val = js_ic_get_field_miss(ctx, slot, obj);         \
+                    if (unlikely(JS_IsException(val)))                  \
+                        goto exception;                                 \
+                }                                                       \
+                if (keep) {                                             \
+                    *sp++ = val;                                        \
+                } else {                                                \
+                    JS_FreeValue(ctx, sp[-1]);                          \
+                    sp[-1] = val;                                       \
+                }                                                       \
+            }
+
+        CASE(OP_get_field_ic):
+            GET_FIELD_IC(0);
+            BREAK;
+
+        CASE(OP_get_field2_ic):
+            GET_FIELD_IC(1);
+            BREAK;
+
+        CASE(OP_put_field_ic):
+            {
+                int ret;
+                JSValue obj;
+                JSInlineCacheSlot *slot;
+                JSProperty *pr;
+
+                slot = &b->ic->slots[get_u32(pc)];
+                pc += 4;
+                obj = sp[-2];
+                if (likely(JS_VALUE_GET_TAG(obj) == JS_TAG_OBJECT &&
+                           (pr = js_ic_find(slot, JS_VALUE_GET_OBJ(obj))))) {
+                    IC_STAT(rt, ic_hit_count);
+                    set_value(ctx, &pr->u.value, sp[-1]);
+                    JS_FreeValue(ctx, obj);
+                    sp -= 2;
+                } else {
+                    sf->cur_pc = pc;
+                    ret = js_ic_put_field_miss(ctx, slot, obj, sp[-1]);
+                    JS_FreeValue(ctx, obj);
+                    sp -= 2;
+                    if (unlikely(ret < 0))
+                        goto exception;
+                }
+            }
             BREAK;
 #endif
             
@@ -18693,6 +19752,7 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                                               JS_PROP_LENGTH)) == JS_PROP_WRITABLE)) {
                         /* fast path */
                         set_value(ctx, &pr->u.value, sp[-1]);
+                        IC_REWRITE(IC_OP(OP_put_field_ic), obj, p);
                     } else {
                         goto put_field_slow_path;
                     }
@@ -19195,6 +20255,7 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
         CASE(OP_add):
             {
                 JSValue op1, op2;
+                double d1, d2;
                 op1 = sp[-2];
                 op2 = sp[-1];
                 if (likely(JS_VALUE_IS_BOTH_INT(op1, op2))) {
@@ -19204,9 +20265,11 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                         goto add_slow;
                     sp[-2] = JS_NewInt32(ctx, r);
                     sp--;
-                } else if (JS_VALUE_IS_BOTH_FLOAT(op1, op2)) {
-                    sp[-2] = __JS_NewFloat64(ctx, JS_VALUE_GET_FLOAT64(op1) +
-                                             JS_VALUE_GET_FLOAT64(op2));
+                } else if (js_get_float64_operands(op1, op2, &d1, &d2)) {
+#if SHORT_OPCODES
+                    js_quicken(b, pc, OP_add_f64);
+#endif
+                    sp[-2] = __JS_NewFloat64(ctx, d1 + d2);
                     sp--;
                 } else if (JS_IsString(op1) && JS_IsString(op2)) {
                     sp[-2] = JS_ConcatString(ctx, op1, op2);
@@ -19273,6 +20336,7 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
         CASE(OP_sub):
             {
                 JSValue op1, op2;
+                double d1, d2;
                 op1 = sp[-2];
                 op2 = sp[-1];
                 if (likely(JS_VALUE_IS_BOTH_INT(op1, op2))) {
@@ -19282,9 +20346,11 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                         goto binary_arith_slow;
                     sp[-2] = JS_NewInt32(ctx, r);
                     sp--;
-                } else if (JS_VALUE_IS_BOTH_FLOAT(op1, op2)) {
-                    sp[-2] = __JS_NewFloat64(ctx, JS_VALUE_GET_FLOAT64(op1) -
-                                             JS_VALUE_GET_FLOAT64(op2));
+                } else if (js_get_float64_operands(op1, op2, &d1, &d2)) {
+#if SHORT_OPCODES
+                    js_quicken(b, pc, OP_sub_f64);
+#endif
+                    sp[-2] = __JS_NewFloat64(ctx, d1 - d2);
                     sp--;
                 } else {
                     goto binary_arith_slow;
@@ -19294,7 +20360,7 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
         CASE(OP_mul):
             {
                 JSValue op1, op2;
-                double d;
+                double d, d1, d2;
                 op1 = sp[-2];
                 op2 = sp[-1];
                 if (likely(JS_VALUE_IS_BOTH_INT(op1, op2))) {
@@ -19314,8 +20380,11 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                     }
                     sp[-2] = JS_NewInt32(ctx, r);
                     sp--;
-                } else if (JS_VALUE_IS_BOTH_FLOAT(op1, op2)) {
-                    d = JS_VALUE_GET_FLOAT64(op1) * JS_VALUE_GET_FLOAT64(op2);
+                } else if (js_get_float64_operands(op1, op2, &d1, &d2)) {
+#if SHORT_OPCODES
+                    js_quicken(b, pc, OP_mul_f64);
+#endif
+                    d = d1 * d2;
                 mul_fp_res:
                     sp[-2] = __JS_NewFloat64(ctx, d);
                     sp--;
@@ -19327,6 +20396,7 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
         CASE(OP_div):
             {
                 JSValue op1, op2;
+                double d1, d2;
                 op1 = sp[-2];
                 op2 = sp[-1];
                 if (likely(JS_VALUE_IS_BOTH_INT(op1, op2))) {
@@ -19335,11 +20405,34 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
                     v2 = JS_VALUE_GET_INT(op2);
                     sp[-2] = JS_NewFloat64(ctx, (double)v1 / (double)v2);
                     sp--;
+                } else if (js_get_float64_operands(op1, op2, &d1, &d2)) {
+                    sp[-2] = __JS_NewFloat64(ctx, d1 / d2);
+                    sp--;
                 } else {
                     goto binary_arith_slow;
                 }
             }
             BREAK;
+#if SHORT_OPCODES
+#define OP_ARITH_F64(opcode, generic_opcode, binary_op)                 \
+            CASE(opcode):                                               \
+                {                                                       \
+                double d1, d2;                                          \
+                if (likely(js_get_float64_operands(sp[-2], sp[-1], &d1, &d2))) { \
+                    sp[-2] = __JS_NewFloat64(ctx, d1 binary_op d2);     \
+                    sp--;                                               \
+                } else {                                                \
+                    /* restore the generic opcode and execute it */     \
+                    pc--;                                               \
+                    *(uint8_t *)pc = generic_opcode;                    \
+                }                                                       \
+                }                                                       \
+            BREAK
+
+            OP_ARITH_F64(OP_add_f64, OP_add, +);
+            OP_ARITH_F64(OP_sub_f64, OP_sub, -);
+            OP_ARITH_F64(OP_mul_f64, OP_mul, *);
+#endif
         CASE(OP_mod):
             {
                 JSValue op1, op2;
@@ -19675,11 +20768,15 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
             CASE(opcode):                                 \
                 {                                         \
                 JSValue op1, op2;                         \
+                double d1, d2;                            \
                 op1 = sp[-2];                             \
                 op2 = sp[-1];                                   \
                 if (likely(JS_VALUE_IS_BOTH_INT(op1, op2))) {           \
                     sp[-2] = JS_NewBool(ctx, JS_VALUE_GET_INT(op1) binary_op JS_VALUE_GET_INT(op2)); \
                     sp--;                                               \
+                } else if (js_get_float64_operands(op1, op2, &d1, &d2)) { \
+                    sp[-2] = JS_NewBool(ctx, d1 binary_op d2);          \
+                    sp--;                                               \
                 } else {                                                \
                     sf->cur_pc = pc;                                    \
                     if (slow_call)                                      \
@@ -19698,6 +20795,43 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
             OP_CMP(OP_strict_eq, ==, js_strict_eq_slow(ctx, sp, 0));
             OP_CMP(OP_strict_neq, !=, js_strict_eq_slow(ctx, sp, 1));
 
+#if SHORT_OPCODES
+#define OP_CMP_IF_FALSE8(opcode, binary_op, slow_call)                  \
+            CASE(opcode):                                               \
+                {                                                       \
+                JSValue op1, op2;                                       \
+                double d1, d2;                                          \
+                int res;                                                \
+                op1 = sp[-2];                                           \
+                op2 = sp[-1];                                           \
+                pc += 1;                                                \
+                if (likely(JS_VALUE_IS_BOTH_INT(op1, op2))) {           \
+                    res = JS_VALUE_GET_INT(op1) binary_op JS_VALUE_GET_INT(op2); \
+                } else if (js_get_float64_operands(op1, op2, &d1, &d2)) { \
+                    res = d1 binary_op d2;                              \
+                } else {                                                \
+                    sf->cur_pc = pc;                                    \
+                    if (slow_call)                                      \
+                        goto exception;                                 \
+                    res = JS_VALUE_GET_BOOL(sp[-2]);                    \
+                }                                                       \
+                sp -= 2;                                                \
+                if (!res) {                                             \
+                    pc += (int8_t)pc[-1] - 1;                           \
+                }                                                       \
+                if (unlikely(js_poll_interrupts(ctx)))                  \
+                    goto exception;                                     \
+                }                                                       \
+            BREAK
+
+            OP_CMP_IF_FALSE8(OP_lt_if_false8, <, js_relational_slow(ctx, sp, OP_lt));
+            OP_CMP_IF_FALSE8(OP_lte_if_false8, <=, js_relational_slow(ctx, sp, OP_lte));
+            OP_CMP_IF_FALSE8(OP_gt_if_false8, >, js_relational_slow(ctx, sp, OP_gt));
+            OP_CMP_IF_FALSE8(OP_gte_if_false8, >=, js_relational_slow(ctx, sp, OP_gte));
+            OP_CMP_IF_FALSE8(OP_strict_eq_if_false8, ==, js_strict_eq_slow(ctx, sp, 0));
+            OP_CMP_IF_FALSE8(OP_strict_neq_if_false8, !=, js_strict_eq_slow(ctx, sp, 1));
+#endif
+
         CASE(OP_in):
             sf->cur_pc = pc;
             if (js_operator_in(ctx, sp))
@@ -20008,6 +21142,42 @@ static JSValue JS_CallInternal(JSContext *caller_ctx, JSValueConst func_obj,
         }
     }
     rt->current_stack_frame = sf->prev_frame;
+    if (inline_frame) {
+        JSInlineFrame *f = inline_frame;
+        int call_argc, n;
+
+        /* return to the caller. Its function, buffers and realm are
+           found from its stack frame. */
+        inline_frame = f->prev;
+        sf = sf->prev_frame;
+        pc = sf->cur_pc;
+        sp = f->sp;
+        local_buf = f->local_buf;
+        this_obj = f->this_obj;
+        argv = f->argv;
+        argc = f->argc;
+        call_argc = f->call_argc;
+        opcode = f->call_opcode;
+        js_free_inline_frame(rt, f);
+        p = JS_VALUE_GET_OBJ(sf->cur_func);
+        b = p->u.func.function_bytecode;
+        ctx = b->realm;
+        var_refs = p->u.func.var_refs;
+        arg_buf = sf->arg_buf;
+        var_buf = sf->var_buf;
+        stack_buf = var_buf + b->var_count;
+
+        if (unlikely(JS_IsException(ret_val)))
+            goto exception;
+        if (opcode == OP_tail_call || opcode == OP_tail_call_method)
+            goto done;
+        n = (opcode == OP_call_method) ? 2 : 1;
+        for(pval = sp - call_argc - n; pval < sp; pval++)
+            JS_FreeValue(ctx, *pval);
+        sp -= call_argc + n;
+        *sp++ = ret_val;
+        goto restart;
+    }
     return ret_val;
 }
 
@@ -20197,6 +21367,11 @@ static JSAsyncFunctionState *async_func_init(JSContext *ctx,
     JSStackFrame *sf;
     int local_count, i, arg_buf_len, n;
 
+    p = JS_VALUE_GET_OBJ(func_obj);
+    if (unlikely(p->u.func.function_bytecode->is_lazy) &&
+        !js_function_resolve_lazy(ctx, p))
+        return NULL;
+
     s = js_mallocz(ctx, sizeof(*s));
     if (!s)
         return NULL;
@@ -20205,7 +21380,6 @@ static JSAsyncFunctionState *async_func_init(JSContext *ctx,
 
     sf = &s->frame;
     init_list_head(&sf->var_ref_list);
-    p = JS_VALUE_GET_OBJ(func_obj);
     b = p->u.func.function_bytecode;
     sf->js_mode = b->js_mode | JS_MODE_ASYNC;
     sf->cur_pc = b->byte_code_buf;
@@ -21220,6 +22394,7 @@ typedef struct JumpSlot {
     int size;
     int pos;
     int label;
+    int cmp_op; /* != 0 if if_false preceded by this comparison opcode */
 } JumpSlot;
 
 typedef struct LabelSlot {
@@ -21293,6 +22468,10 @@ typedef struct JSFunctionDef {
     BOOL arguments_allowed; /* true if the 'arguments' identifier is allowed */
     BOOL is_derived_class_constructor;
     BOOL in_function_body;
+    BOOL is_lazy; /* the body is compiled on the first call, see
+                     JS_SetLazyFunctions() */
+    BOOL lazy_disabled; /* true if the function or a nested function
+                           uses import.meta or a private name */
     JSFunctionKindEnum func_kind : 8;
     JSParseFunctionEnum func_type : 8;
     uint8_t js_mode; /* bitmap of JS_MODE_x */
@@ -21414,11 +22593,12 @@ typedef struct JSParseState {
     BOOL is_module; /* parsing a module */
     BOOL allow_html_comments;
     BOOL ext_json; /* true if accepting JSON superset */
+    BOOL lazy_compile; /* compiling the body of a lazy function */
     GetLineColCache get_line_col_cache;
 } JSParseState;
 
 typedef struct JSOpCode {
-#ifdef DUMP_BYTECODE
+#if defined(DUMP_BYTECODE) || defined(DUMP_OPCODE_PROFILE)
     const char *name;
 #endif
     uint8_t size; /* in bytes */
@@ -21431,7 +22611,7 @@ typedef struct JSOpCode {
 
 static const JSOpCode opcode_info[OP_COUNT + (OP_TEMP_END - OP_TEMP_START)] = {
 #define FMT(f)
-#ifdef DUMP_BYTECODE
+#if defined(DUMP_BYTECODE) || defined(DUMP_OPCODE_PROFILE)
 #define DEF(id, size, n_pop, n_push, f) { #id, size, n_pop, n_push, OP_FMT_ ## f },
 #else
 #define DEF(id, size, n_pop, n_push, f) { size, n_pop, n_push, OP_FMT_ ## f },
@@ -21453,6 +22633,90 @@ static const JSOpCode opcode_info[OP_COUNT + (OP_TEMP_END - OP_TEMP_START)] = {
 #define short_opcode_info(op) opcode_info[op]
 #endif
 
+#ifdef DUMP_OPCODE_PROFILE
+#define OP_PROFILE_DUMP_COUNT 40
+
+typedef struct JSOpProfileEntry {
+    uint32_t ops; /* same encoding as JSOpProfileTriple */
+    int len;
+    uint64_t count;
+} JSOpProfileEntry;
+
+static int js_op_profile_entry_cmp(const void *a, const void *b, void *opaque)
+{
+    const JSOpProfileEntry *e1 = a, *e2 = b;
+    if (e1->count != e2->count)
+        return e1->count < e2->count ? 1 : -1;
+    return (e1->ops > e2->ops) - (e1->ops < e2->ops);
+}
+
+static void js_dump_opcode_profile_table(JSOpProfile *s, const char *title,
+                                         JSOpProfileEntry *tab, int n)
+{
+    int i, j;
+
+    rqsort(tab, n, sizeof(tab[0]), js_op_profile_entry_cmp, NULL);
+    printf("%s:\n", title);
+    for(i = 0; i < n && i < OP_PROFILE_DUMP_COUNT; i++) {
+        printf("  %12" PRIu64 " %5.2f%% ", tab[i].count,
+               tab[i].count * 100.0 / s->total_count);
+        for(j = 0; j < tab[i].len; j++) {
+            printf(" %s", short_opcode_info((tab[i].ops >> (8 * j)) & 0xff).name);
+        }
+        printf("\n");
+    }
+}
+
+static void js_dump_opcode_profile(JSRuntime *rt)
+{
+    JSOpProfile *s = rt->op_profile;
+    JSOpProfileEntry *tab;
+    int i, j, n;
+
+    if (!s || s->total_count == 0)
+        return;
+    tab = js_malloc_rt(rt, sizeof(tab[0]) * max_int(256 * 256, 1 << OP_PROFILE_TRIPLE_HASH_BITS));
+    if (!tab)
+        return;
+    printf("opcode profile: %" PRIu64 " executed opcodes\n", s->total_count);
+    n = 0;
+    for(i = 0; i < 256; i++) {
+        if (s->op_count[i] != 0) {
+            tab[n].ops = i;
+            tab[n].len = 1;
+            tab[n].count = s->op_count[i];
+            n++;
+        }
+    }
+    js_dump_opcode_profile_table(s, "opcodes", tab, n);
+    n = 0;
+    for(i = 0; i < 256; i++) {
+        for(j = 0; j < 256; j++) {
+            if (s->pair_count[i][j] != 0) {
+                tab[n].ops = i | (j << 8);
+                tab[n].len = 2;
+                tab[n].count = s->pair_count[i][j];
+                n++;
+            }
+        }
+    }
+    js_dump_opcode_profile_table(s, "pairs", tab, n);
+    n = 0;
+    for(i = 0; i < countof(s->triples); i++) {
+        if (s->triples[i].ops != 0) {
+            tab[n].ops = s->triples[i].ops & 0xffffff;
+            tab[n].len = 3;
+            tab[n].count = s->triples[i].count;
+            n++;
+        }
+    }
+    js_dump_opcode_profile_table(s, "triples", tab, n);
+    if (s->lost_count != 0)
+        printf("%" PRIu64 " triples not counted\n", s->lost_count);
+    js_free_rt(rt, tab);
+}
+#endif /* DUMP_OPCODE_PROFILE */
+
 static __exception int next_token(JSParseState *s);
 
 static void free_token(JSParseState *s, JSToken *token)
@@ -21605,7 +22869,9 @@ static int js_parse_error_v(JSParseState *s, const uint8_t *ptr, const char *fmt
 {
     JSContext *ctx = s->ctx;
     int line_num, col_num;
-    line_num = get_line_col(&col_num, s->buf_start, ptr - s->buf_start);
+    /* the cache may start after the first line when a lazy function
+       body is compiled */
+    line_num = get_line_col_cached(&s->get_line_col_cache, &col_num, ptr);
     JS_ThrowError2(ctx, JS_SYNTAX_ERROR, fmt, ap, FALSE);
     build_backtrace(ctx, ctx->rt->current_exception, s->filename,
                     line_num + 1, col_num + 1, 0);
@@ -23225,6 +24491,17 @@ static int emit_goto(JSParseState *s, int opcode, int label)
     return -1;
 }
 
+/* The lazy functions are not compiled as module code and their stub
+   does not keep the private names of the enclosing classes, so the
+   functions using import.meta or a private name are compiled at once */
+static void js_parse_disable_lazy(JSParseState *s)
+{
+    JSFunctionDef *fd;
+
+    for(fd = s->cur_func; fd != NULL; fd = fd->parent)
+        fd->lazy_disabled = TRUE;
+}
+
 /* return the constant pool index. 'val' is not duplicated. */
 static int cpool_add(JSParseState *s, JSValue val)
 {
@@ -26325,6 +27602,7 @@ static __exception int js_parse_postfix_expr(JSParseState *s, int parse_flags)
                 return js_parse_error(s, "meta expected");
             if (!s->is_module)
                 return js_parse_error(s, "import.meta only valid in module code");
+            js_parse_disable_lazy(s);
             if (next_token(s))
                 return -1;
             emit_op(s, OP_special_object);
@@ -26693,6 +27971,7 @@ static __exception int js_parse_postfix_expr(JSParseState *s, int parse_flags)
                 if (has_optional_chain) {
                     optional_chain_test(s, &optional_chaining_label, 1);
                 }
+                js_parse_disable_lazy(s);
                 emit_op(s, OP_scope_get_private_field);
                 emit_atom(s, s->token.u.ident.atom);
                 emit_u16(s, s->cur_func->scope_level);
@@ -27009,6 +28288,7 @@ static __exception int js_parse_expr_binary(JSParseState *s, int level,
                peek_token(s, FALSE) == TOK_IN) {
         JSAtom atom;
 
+        js_parse_disable_lazy(s);
         atom = JS_DupAtom(s->ctx, s->token.u.ident.atom);
         if (next_token(s))
             goto fail_private_in;
@@ -30312,6 +31592,19 @@ static JSValue js_dynamic_import_job(JSContext *ctx,
     if (!filename)
         goto exception;
 
+    if (ctx->rt->module_import_hook) {
+        int res = ctx->rt->module_import_hook(ctx, basename, filename,
+                                              attributes, resolving_funcs,
+                                              ctx->rt->module_import_opaque);
+        if (res <= 0) {
+            JS_FreeCString(ctx, filename);
+            if (res < 0)
+                goto exception;
+            JS_FreeCString(ctx, basename);
+            return JS_UNDEFINED;
+        }
+    }
+
     JS_LoadModuleInternal(ctx, basename, filename,
                           resolving_funcs, attributes);
     JS_FreeCString(ctx, filename);
@@ -32153,6 +33446,19 @@ static void var_object_test(JSContext *ctx, JSFunctionDef *s,
     s->jump_size++;
 }
 
+/* TRUE if 'fd' is nested in a lazy function. Only its variable
+   references are needed. */
+static BOOL js_function_def_in_lazy(JSFunctionDef *fd)
+{
+    JSFunctionDef *fd1;
+
+    for(fd1 = fd->parent; fd1 != NULL; fd1 = fd1->parent) {
+        if (fd1->is_lazy)
+            return TRUE;
+    }
+    return FALSE;
+}
+
 /* return the position of the next opcode or -1 if error */
 static int resolve_scope_var(JSContext *ctx, JSFunctionDef *s,
                              JSAtom var_name, int scope_level, int op,
@@ -32349,7 +33655,10 @@ static int resolve_scope_var(JSContext *ctx, JSFunctionDef *s,
             vd = &fd->vars[idx];
             if (vd->var_name == var_name) {
                 if (op == OP_scope_put_var || op == OP_scope_make_ref) {
-                    if (vd->is_const) {
+                    /* a lazy function captures it so that its body
+                       resolves it as the stub when compiled later */
+                    if (vd->is_const && !s->is_lazy &&
+                        !js_function_def_in_lazy(s)) {
                         dbuf_putc(bc, OP_throw_error);
                         dbuf_put_u32(bc, JS_DupAtom(ctx, var_name));
                         dbuf_putc(bc, JS_THROW_VAR_RO);
@@ -33933,6 +35242,17 @@ static int find_jump_target(JSFunctionDef *s, int label0, int *pop, int *pline)
     return label;
 }
 
+#if SHORT_OPCODES
+/* superinstruction of a comparison followed by if_false8 */
+static int cmp_if_false8_opcode(int op)
+{
+    if (op == OP_strict_eq || op == OP_strict_neq)
+        return OP_strict_eq_if_false8 + (op - OP_strict_eq);
+    else
+        return OP_lt_if_false8 + (op - OP_lt);
+}
+#endif
+
 static void push_short_int(DynBuf *bc_out, int val)
 {
 #if SHORT_OPCODES
@@ -34025,6 +35345,7 @@ static __exception int resolve_labels(JSContext *ctx, JSFunctionDef *s)
     int label;
 #if SHORT_OPCODES
     JumpSlot *jp;
+    int cmp_op = 0; /* comparison emitted before the next if_false */
 #endif
 
     label_slots = s->label_slots;
@@ -34158,7 +35479,7 @@ static __exception int resolve_labels(JSContext *ctx, JSFunctionDef *s)
         case OP_call_method:
             {
                 /* detect and transform tail calls */
-                int argc;
+                int argc, pos1;
                 argc = get_u16(bc_buf + pos + 1);
                 if (code_match(&cc, pos_next, OP_return, -1)) {
                     if (cc.line_num >= 0) line_num = cc.line_num;
@@ -34167,6 +35488,32 @@ static __exception int resolve_labels(JSContext *ctx, JSFunctionDef *s)
                     pos_next = skip_dead_code(s, bc_buf, bc_len, cc.pos, &line_num);
                     break;
                 }
+                if (OPTIMIZE && code_match(&cc, pos_next, OP_goto, -1)) {
+                    /* call followed by a jump to return, as in
+                       'return c ? f() : g()' */
+                    label = find_jump_target(s, cc.label, &op1, NULL);
+                    if (op1 == OP_return) {
+                        update_label(s, label, -1);
+                        add_pc2line_info(s, bc_out.size, line_num);
+                        put_short_code(&bc_out, op + 1, argc);
+                        pos_next = skip_dead_code(s, bc_buf, bc_len, cc.pos, &line_num);
+                        break;
+                    }
+                    /* the jump is resolved again when it is emitted */
+                    update_label(s, label, -1);
+                    update_label(s, cc.label, +1);
+                }
+                /* the return may also follow labels which are kept
+                   for the other branches */
+                for(pos1 = pos_next; pos1 < bc_len &&
+                        (bc_buf[pos1] == OP_label || bc_buf[pos1] == OP_line_num);
+                    pos1 += opcode_info[bc_buf[pos1]].size)
+                    continue;
+                if (pos1 < bc_len && bc_buf[pos1] == OP_return) {
+                    add_pc2line_info(s, bc_out.size, line_num);
+                    put_short_code(&bc_out, op + 1, argc);
+                    break;
+                }
                 add_pc2line_info(s, bc_out.size, line_num);
                 put_short_code(&bc_out, op, argc);
                 break;
@@ -34265,13 +35612,22 @@ static __exception int resolve_labels(JSContext *ctx, JSFunctionDef *s)
             jp->size = 4;
             jp->pos = bc_out.size + 1;
             jp->label = label;
+            jp->cmp_op = cmp_op;
+            cmp_op = 0;
 
             if (ls->addr == -1) {
                 int diff = ls->pos2 - pos - 1;
                 if (diff < 128 && (op == OP_if_false || op == OP_if_true || op == OP_goto)) {
                     jp->size = 1;
-                    jp->op = OP_if_false8 + (op - OP_if_false);
-                    dbuf_putc(&bc_out, OP_if_false8 + (op - OP_if_false));
+                    if (jp->cmp_op) {
+                        /* replace the comparison by the superinstruction */
+                        jp->op = cmp_if_false8_opcode(jp->cmp_op);
+                        jp->pos = bc_out.size;
+                        bc_out.buf[bc_out.size - 1] = jp->op;
+                    } else {
+                        jp->op = OP_if_false8 + (op - OP_if_false);
+                        dbuf_putc(&bc_out, OP_if_false8 + (op - OP_if_false));
+                    }
                     dbuf_putc(&bc_out, 0);
                     if (!add_reloc(ctx, ls, bc_out.size - 1, 1))
                         goto fail;
@@ -34288,6 +35644,14 @@ static __exception int resolve_labels(JSContext *ctx, JSFunctionDef *s)
                 }
             } else {
                 int diff = ls->addr - bc_out.size - 1;
+                if (jp->cmp_op && diff + 1 == (int8_t)(diff + 1)) {
+                    jp->size = 1;
+                    jp->op = cmp_if_false8_opcode(jp->cmp_op);
+                    jp->pos = bc_out.size;
+                    bc_out.buf[bc_out.size - 1] = jp->op;
+                    dbuf_putc(&bc_out, diff + 1);
+                    break;
+                }
                 if (diff == (int8_t)diff && (op == OP_if_false || op == OP_if_true || op == OP_goto)) {
                     jp->size = 1;
                     jp->op = OP_if_false8 + (op - OP_if_false);
@@ -34359,6 +35723,38 @@ static __exception int resolve_labels(JSContext *ctx, JSFunctionDef *s)
             }
             goto no_change;
 
+#if SHORT_OPCODES
+        case OP_lt:
+        case OP_lte:
+        case OP_gt:
+        case OP_gte:
+        case OP_strict_eq:
+        case OP_strict_neq:
+            if (OPTIMIZE && code_match(&cc, pos_next, OP_if_false, -1)) {
+                /* the comparison is fused with the jump if the jump
+                   is short and is not simplified by the if_false
+                   transformations (see has_label and the final jump
+                   optimizations) */
+                int pos1 = cc.pos, label0 = cc.label;
+
+                label = find_jump_target(s, label0, &op1, NULL);
+                if (!code_has_label(&cc, pos1, label) &&
+                    !(code_match(&cc, pos1, OP_goto, -1) &&
+                      code_has_label(&cc, cc.pos, label))) {
+                    add_pc2line_info(s, bc_out.size, line_num);
+                    dbuf_putc(&bc_out, op);
+                    cmp_op = op;
+                    op = OP_if_false;
+                    pos_next = pos1;
+                    goto has_label;
+                }
+                /* the jump is resolved again when it is emitted */
+                update_label(s, label, -1);
+                update_label(s, label0, +1);
+            }
+            goto no_change;
+#endif
+
         case OP_null:
 #if SHORT_OPCODES
             if (OPTIMIZE) {
@@ -34499,6 +35895,11 @@ static __exception int resolve_labels(JSContext *ctx, JSFunctionDef *s)
                     pos_next = cc.pos;
                     break;
                 }
+                /* transformation: push_atom_value(x) to_propkey -> push_atom_value(x) */
+                if (code_match(&cc, pos_next, OP_to_propkey, -1)) {
+                    if (cc.line_num >= 0) line_num = cc.line_num;
+                    pos_next = cc.pos;
+                }
 #if SHORT_OPCODES
                 if (atom == JS_ATOM_empty_string) {
                     JS_FreeAtom(ctx, atom);
@@ -34605,6 +36006,15 @@ static __exception int resolve_labels(JSContext *ctx, JSFunctionDef *s)
                     if (line2 >= 0) line_num = line2;
                     break;
                 }
+                /* Transformation: dup put_var(n) drop -> put_var(n) */
+                if (code_match(&cc, pos_next, OP_put_var, -1, OP_drop, -1)) {
+                    if (cc.line_num >= 0) line_num = cc.line_num;
+                    add_pc2line_info(s, bc_out.size, line_num);
+                    dbuf_putc(&bc_out, OP_put_var);
+                    dbuf_put_u16(&bc_out, cc.idx);
+                    pos_next = cc.pos;
+                    break;
+                }
             }
             goto no_change;
 
@@ -34697,10 +36107,14 @@ static __exception int resolve_labels(JSContext *ctx, JSFunctionDef *s)
         case OP_put_arg:
         case OP_put_var_ref:
             if (OPTIMIZE) {
-                /* transformation: put_x(n) get_x(n) -> set_x(n) */
+                /* transformation: put_x(n) get_x(n) -> set_x(n)
+                   put_loc(n) get_loc_check(n) -> set_loc(n)
+                 */
                 int idx;
                 idx = get_u16(bc_buf + pos + 1);
-                if (code_match(&cc, pos_next, op - 1, idx, -1)) {
+                if (code_match(&cc, pos_next, op - 1, idx, -1) ||
+                    (op == OP_put_loc &&
+                     code_match(&cc, pos_next, OP_get_loc_check, idx, -1))) {
                     if (cc.line_num >= 0) line_num = cc.line_num;
                     add_pc2line_info(s, bc_out.size, line_num);
                     put_short_code(&bc_out, op + 1, idx);
@@ -34833,6 +36247,13 @@ static __exception int resolve_labels(JSContext *ctx, JSFunctionDef *s)
                 if (diff >= -128 && diff <= 127 + delta) {
                     //put_u8(bc_out.buf + pos, diff);
                     jp->size = 1;
+                    if (jp->cmp_op) {
+                        /* replace the comparison by the superinstruction
+                           followed by the 8 bit offset */
+                        bc_out.buf[pos - 2] = jp->op = cmp_if_false8_opcode(jp->cmp_op);
+                        pos = jp->pos = pos - 1;
+                        delta = 4;
+                    } else
                     if (op == OP_goto16) {
                         bc_out.buf[pos - 1] = jp->op = OP_goto8;
                     } else {
@@ -35064,6 +36485,12 @@ static __exception int compute_stack_size(JSContext *ctx,
             break;
         case OP_if_true8:
         case OP_if_false8:
+        case OP_lt_if_false8:
+        case OP_lte_if_false8:
+        case OP_gt_if_false8:
+        case OP_gte_if_false8:
+        case OP_strict_eq_if_false8:
+        case OP_strict_neq_if_false8:
             diff = (int8_t)bc_buf[pos + 1];
             if (ss_check(ctx, s, pos + 1 + diff, op, stack_len, catch_pos))
                 goto fail;
@@ -35233,6 +36660,34 @@ static int add_global_variables(JSContext *ctx, JSFunctionDef *fd)
     return 0;
 }
 
+/* Replace the resolved body of the lazy function 'fd' by a stub. Its
+   closure variables are the ones of the whole body. The body is
+   compiled from its source by the first call and stored in
+   cpool[0]. */
+static int js_lazy_function_stub(JSContext *ctx, JSFunctionDef *fd)
+{
+    int i;
+
+    free_bytecode_atoms(ctx->rt, fd->byte_code.buf, fd->byte_code.size,
+                        fd->use_short_opcodes);
+    fd->byte_code.size = 0;
+    dbuf_putc(&fd->byte_code, OP_undefined);
+    dbuf_putc(&fd->byte_code, OP_return);
+    if (dbuf_error(&fd->byte_code)) {
+        JS_ThrowOutOfMemory(ctx);
+        return -1;
+    }
+    for(i = 0; i < fd->cpool_count; i++)
+        JS_FreeValue(ctx, fd->cpool[i]);
+    fd->cpool_count = 0;
+    if (js_resize_array(ctx, (void *)&fd->cpool, sizeof(fd->cpool[0]),
+                        &fd->cpool_size, 1))
+        return -1;
+    fd->cpool[fd->cpool_count++] = JS_UNDEFINED;
+    ctx->rt->lazy_skipped_count++;
+    return 0;
+}
+
 /* create a function object from a function definition. The function
    definition is freed. All the child functions are also created. It
    must be done this way to resolve all the variables. */
@@ -35314,6 +36769,14 @@ static JSValue js_create_function(JSContext *ctx, JSFunctionDef *fd)
     if (resolve_variables(ctx, fd))
         goto fail;
 
+    if (js_function_def_in_lazy(fd)) {
+        /* compiled again with the lazy function */
+        js_free_function_def(ctx, fd);
+        return JS_UNDEFINED;
+    }
+    if (fd->is_lazy && js_lazy_function_stub(ctx, fd))
+        goto fail;
+
 #if defined(DUMP_BYTECODE) && (DUMP_BYTECODE & 2)
     if (!fd->strip_debug) {
         printf("pass 2\n");
@@ -35439,6 +36902,8 @@ static JSValue js_create_function(JSContext *ctx, JSFunctionDef *fd)
     b->arguments_allowed = fd->arguments_allowed;
     b->is_direct_or_indirect_eval = (fd->eval_type == JS_EVAL_TYPE_DIRECT ||
                                      fd->eval_type == JS_EVAL_TYPE_INDIRECT);
+    b->is_lazy = fd->is_lazy;
+    b->lazy_func_expr = fd->is_lazy && fd->is_func_expr;
     b->realm = JS_DupContext(ctx);
 
     add_gc_object(ctx->rt, &b->header, JS_GC_OBJ_TYPE_FUNCTION_BYTECODE);
@@ -35474,6 +36939,8 @@ static void free_function_bytecode(JSRuntime *rt, JSFunctionBytecode *b)
 #endif
     if (b->byte_code_buf)
         free_bytecode_atoms(rt, b->byte_code_buf, b->byte_code_len, TRUE);
+    if (b->ic)
+        js_inline_cache_free(rt, b->ic);
 
     if (b->vardefs) {
         for(i = 0; i < b->arg_count + b->var_count; i++) {
@@ -35676,6 +37143,29 @@ static JSFunctionDef *js_parse_function_class_fields_init(JSParseState *s)
     return fd;
 }
 
+static BOOL js_parse_lazy_allowed(JSParseState *s, JSFunctionDef *fd,
+                                  JSParseFunctionEnum func_type)
+{
+    JSFunctionDef *fd1;
+
+    if (!s->ctx->rt->lazy_functions)
+        return FALSE;
+    if (func_type != JS_PARSE_FUNC_STATEMENT &&
+        func_type != JS_PARSE_FUNC_VAR &&
+        func_type != JS_PARSE_FUNC_EXPR)
+        return FALSE;
+    /* the body is compiled later from the saved function source */
+    if (fd->strip_source || !fd->has_simple_parameter_list)
+        return FALSE;
+    /* no 'with' statement nor direct eval can add bindings to the
+       scope chain of the function */
+    for(fd1 = fd; fd1 != NULL; fd1 = fd1->parent) {
+        if (!(fd1->js_mode & JS_MODE_STRICT))
+            return FALSE;
+    }
+    return TRUE;
+}
+
 /* func_name must be JS_ATOM_NULL for JS_PARSE_FUNC_STATEMENT and
    JS_PARSE_FUNC_EXPR, JS_PARSE_FUNC_ARROW and JS_PARSE_FUNC_VAR */
 static __exception int js_parse_function_decl2(JSParseState *s,
@@ -36106,10 +37596,21 @@ static __exception int js_parse_function_decl2(JSParseState *s,
     if (js_parse_function_check_names(s, fd, func_name))
         goto fail;
 
+    if (s->lazy_compile) {
+        /* the function being compiled from its lazy stub */
+        s->lazy_compile = FALSE;
+    } else {
+        fd->is_lazy = js_parse_lazy_allowed(s, fd, func_type);
+    }
+
     while (s->token.val != '}') {
         if (js_parse_source_element(s))
             goto fail;
     }
+    /* a direct eval needs its closure variables in scope order (see
+       add_eval_variables()) */
+    if (fd->has_eval_call || fd->lazy_disabled)
+        fd->is_lazy = FALSE;
     if (!fd->strip_source) {
         /* save the function source code */
         fd->source_len = s->buf_ptr - ptr;
@@ -36461,10 +37962,10 @@ static JSValue __JS_EvalInternal(JSContext *ctx, JSValueConst this_obj,
     fun_obj = js_create_function(ctx, fd);
     if (JS_IsException(fun_obj))
         goto fail1;
-    /* Could add a flag to avoid resolution if necessary */
     if (m) {
         m->func_obj = fun_obj;
-        if (js_resolve_module(ctx, m) < 0)
+        if (!(flags & JS_EVAL_FLAG_NO_RESOLVE) &&
+            js_resolve_module(ctx, m) < 0)
             goto fail1;
         fun_obj = JS_NewModuleValue(ctx, m);
     }
@@ -36684,7 +38185,7 @@ typedef enum BCTagEnum {
     BC_TAG_OBJECT_REFERENCE,
 } BCTagEnum;
 
-#define BC_VERSION 5
+#define BC_VERSION 6
 
 typedef struct BCWriterState {
     JSContext *ctx;
@@ -36897,7 +38398,8 @@ static void bc_byte_swap(uint8_t *bc_buf, int bc_len)
 }
 
 static int JS_WriteFunctionBytecode(BCWriterState *s,
-                                    const uint8_t *bc_buf1, int bc_len)
+                                    const uint8_t *bc_buf1, int bc_len,
+                                    const JSInlineCache *ic)
 {
     int pos, len, op;
     JSAtom atom;
@@ -36912,6 +38414,20 @@ static int JS_WriteFunctionBytecode(BCWriterState *s,
     pos = 0;
     while (pos < bc_len) {
         op = bc_buf[pos];
+#if SHORT_OPCODES
+        /* restore the original opcode of the inline cached accesses */
+        if (op >= OP_get_field_ic && op <= OP_put_field_ic) {
+            static const uint8_t ic_op[] = { OP_get_field, OP_get_field2,
+                                             OP_put_field };
+            bc_buf[pos] = op = ic_op[op - OP_get_field_ic];
+            put_u32(bc_buf + pos + 1, ic->slots[get_u32(bc_buf + pos + 1)].atom);
+        }
+        /* restore the generic opcode of the quickened instructions */
+        if (op >= OP_add_f64 && op <= OP_mul_f64) {
+            static const uint8_t generic_op[] = { OP_add, OP_sub, OP_mul };
+            bc_buf[pos] = op = generic_op[op - OP_add_f64];
+        }
+#endif
         len = short_opcode_info(op).size;
         switch(short_opcode_info(op).fmt) {
         case OP_FMT_atom:
@@ -37024,6 +38540,8 @@ static int JS_WriteFunctionTag(BCWriterState *s, JSValueConst obj)
     bc_set_flags(&flags, &idx, b->arguments_allowed, 1);
     bc_set_flags(&flags, &idx, b->has_debug, 1);
     bc_set_flags(&flags, &idx, b->is_direct_or_indirect_eval, 1);
+    bc_set_flags(&flags, &idx, b->is_lazy, 1);
+    bc_set_flags(&flags, &idx, b->lazy_func_expr, 1);
     assert(idx <= 16);
     bc_put_u16(s, flags);
     bc_put_u8(s, b->js_mode);
@@ -37069,7 +38587,7 @@ static int JS_WriteFunctionTag(BCWriterState *s, JSValueConst obj)
         bc_put_u16(s, flags);
     }
 
-    if (JS_WriteFunctionBytecode(s, b->byte_code_buf, b->byte_code_len))
+    if (JS_WriteFunctionBytecode(s, b->byte_code_buf, b->byte_code_len, b->ic))
         goto fail;
 
     if (b->has_debug) {
@@ -37912,6 +39430,8 @@ static JSValue JS_ReadFunctionTag(BCReaderState *s)
     bc.arguments_allowed = bc_get_flags(v16, &idx, 1);
     bc.has_debug = bc_get_flags(v16, &idx, 1);
     bc.is_direct_or_indirect_eval = bc_get_flags(v16, &idx, 1);
+    bc.is_lazy = bc_get_flags(v16, &idx, 1);
+    bc.lazy_func_expr = bc_get_flags(v16, &idx, 1);
     bc.read_only_bytecode = s->is_rom_data;
     if (bc_get_u8(s, &v8))
         goto fail;
@@ -38054,7 +39574,8 @@ static JSValue JS_ReadFunctionTag(BCReaderState *s)
             goto fail;
         if (b->debug.source_len) {
             bc_read_trace(s, "source: %d bytes\n", b->source_len);
-            b->debug.source = js_mallocz(ctx, b->debug.source_len);
+            /* zero terminated as lazy functions are parsed from it */
+            b->debug.source = js_mallocz(ctx, b->debug.source_len + 1);
             if (!b->debug.source)
                 goto fail;
             if (bc_get_buf(s, (uint8_t *)b->debug.source, b->debug.source_len))
@@ -59739,6 +61260,948 @@ JSValue JS_NewTypedArrayWithBuffer(JSContext *ctx, JSValueConst buffer,
     return result;
 }
 
+/* Strings: length-delimited creation and borrowed views */
+
+JSValue JS_NewStringLatin1(JSContext *ctx, const uint8_t *buf, size_t len)
+{
+    if (len > JS_STRING_LEN_MAX)
+        return JS_ThrowInternalError(ctx, "string too long");
+    return js_new_string8_len(ctx, (const char *)buf, len);
+}
+
+JSValue JS_NewStringUTF16(JSContext *ctx, const uint16_t *buf, size_t len)
+{
+    if (len > JS_STRING_LEN_MAX)
+        return JS_ThrowInternalError(ctx, "string too long");
+    if (len == 0)
+        return JS_AtomToString(ctx, JS_ATOM_empty_string);
+    return js_new_string16_len(ctx, buf, len);
+}
+
+/* Allocate a string of 'len' characters whose contents are left
+   uninitialized. '*pbuf' points to the character storage (8 or 16 bit)
+   which must be fully written before the string is used. */
+JSValue JS_NewStringBuffer(JSContext *ctx, size_t len, JS_BOOL is_wide_char,
+                           void **pbuf)
+{
+    JSString *str;
+
+    *pbuf = NULL;
+    if (len > JS_STRING_LEN_MAX)
+        return JS_ThrowInternalError(ctx, "string too long");
+    str = js_alloc_string(ctx, len, is_wide_char != 0);
+    if (!str)
+        return JS_EXCEPTION;
+    if (!is_wide_char)
+        str->u.str8[len] = '\0';
+    *pbuf = str->u.str8;
+    return JS_MKPTR(JS_TAG_STRING, str);
+}
+
+/* Return a read-only pointer to the characters of the string '*pval', or
+   NULL if it is not a string. String ropes are linearized first and
+   '*pval' is replaced by the flat string. 8 bit strings are Latin-1 and
+   NUL terminated. The pointer is valid as long as '*pval' is alive. */
+const void *JS_GetStringView(JSContext *ctx, JSValue *pval, uint32_t *plen,
+                             JS_BOOL *pis_wide_char)
+{
+    JSString *p;
+    JSValue val;
+
+    if (JS_VALUE_GET_TAG(*pval) == JS_TAG_STRING_ROPE) {
+        val = js_linearize_string_rope(ctx, JS_DupValue(ctx, *pval));
+        if (JS_IsException(val))
+            return NULL;
+        JS_FreeValue(ctx, *pval);
+        *pval = val;
+    }
+    if (JS_VALUE_GET_TAG(*pval) != JS_TAG_STRING)
+        return NULL;
+    p = JS_VALUE_GET_STRING(*pval);
+    *plen = p->len;
+    *pis_wide_char = p->is_wide_char;
+    return p->u.str8;
+}
+
+/* Context snapshots: restore the builtins of a context to a recorded state */
+
+typedef struct JSPropertySnapshot {
+    JSAtom atom; /* JS_ATOM_NULL for a deleted shape entry */
+    int flags;
+    JSValue value; /* getter for JS_PROP_GETSET */
+    JSValue setter;
+} JSPropertySnapshot;
+
+typedef struct JSObjectSnapshot {
+    JSValue obj;
+    JSValue proto;
+    BOOL extensible;
+    /* same layout as the shape properties at record time */
+    uint32_t prop_count;
+    JSPropertySnapshot *props;
+} JSObjectSnapshot;
+
+struct JSContextSnapshot {
+    JSObjectSnapshot *objs;
+    int count;
+    int size;
+    uint8_t std_array_prototype;
+};
+
+static void js_object_snapshot_free(JSContext *ctx, JSObjectSnapshot *os)
+{
+    uint32_t i;
+
+    if (os->props) {
+        for(i = 0; i < os->prop_count; i++) {
+            JS_FreeAtom(ctx, os->props[i].atom);
+            JS_FreeValue(ctx, os->props[i].value);
+            JS_FreeValue(ctx, os->props[i].setter);
+        }
+        js_free(ctx, os->props);
+        os->props = NULL;
+    }
+    JS_FreeValue(ctx, os->proto);
+    os->proto = JS_NULL;
+    os->prop_count = 0;
+}
+
+static int js_object_snapshot_record(JSContext *ctx, JSObjectSnapshot *os)
+{
+    JSObject *p = JS_VALUE_GET_OBJ(os->obj);
+    JSShapeProperty *prs;
+    JSProperty *pr;
+    JSShape *sh;
+    uint32_t i;
+
+    /* instantiate lazy properties so that the shape is final */
+    sh = p->shape;
+    for(i = 0, prs = get_shape_prop(sh); i < sh->prop_count; i++, prs++) {
+        if ((prs->flags & JS_PROP_TMASK) == JS_PROP_AUTOINIT) {
+            if (JS_AutoInitProperty(ctx, p, prs->atom, &p->prop[i], prs))
+                return -1;
+            sh = p->shape;
+            prs = get_shape_prop(sh) + i;
+        }
+    }
+
+    os->props = js_mallocz(ctx, sizeof(os->props[0]) * max_int(sh->prop_count, 1));
+    if (!os->props)
+        return -1;
+    os->prop_count = sh->prop_count;
+    os->proto = sh->proto ? JS_DupValue(ctx, JS_MKPTR(JS_TAG_OBJECT, sh->proto)) : JS_NULL;
+    os->extensible = p->extensible;
+    for(i = 0, prs = get_shape_prop(sh); i < sh->prop_count; i++, prs++) {
+        JSPropertySnapshot *ps = &os->props[i];
+        pr = &p->prop[i];
+        ps->atom = JS_DupAtom(ctx, prs->atom);
+        ps->flags = prs->flags;
+        ps->value = JS_UNDEFINED;
+        ps->setter = JS_UNDEFINED;
+        if (prs->atom == JS_ATOM_NULL)
+            continue;
+        switch(prs->flags & JS_PROP_TMASK) {
+        case 0:
+            ps->value = JS_DupValue(ctx, pr->u.value);
+            break;
+        case JS_PROP_GETSET:
+            if (pr->u.getset.getter)
+                ps->value = JS_DupValue(ctx, JS_MKPTR(JS_TAG_OBJECT, pr->u.getset.getter));
+            if (pr->u.getset.setter)
+                ps->setter = JS_DupValue(ctx, JS_MKPTR(JS_TAG_OBJECT, pr->u.getset.setter));
+            break;
+        case JS_PROP_VARREF:
+            ps->value = JS_DupValue(ctx, *pr->u.var_ref->pvalue);
+            break;
+        default:
+            break;
+        }
+    }
+    return 0;
+}
+
+static int js_context_snapshot_add(JSContext *ctx, JSContextSnapshot *snap,
+                                   JSValueConst obj)
+{
+    JSObjectSnapshot *os;
+    int i;
+
+    if (JS_VALUE_GET_TAG(obj) != JS_TAG_OBJECT)
+        return 0;
+    for(i = 0; i < snap->count; i++) {
+        if (JS_VALUE_GET_OBJ(snap->objs[i].obj) == JS_VALUE_GET_OBJ(obj))
+            return 0;
+    }
+    if (js_resize_array(ctx, (void **)&snap->objs, sizeof(snap->objs[0]),
+                        &snap->size, snap->count + 1))
+        return -1;
+    os = &snap->objs[snap->count];
+    os->obj = JS_DupValue(ctx, obj);
+    os->proto = JS_NULL;
+    os->prop_count = 0;
+    os->props = NULL;
+    snap->count++;
+    return js_object_snapshot_record(ctx, os);
+}
+
+/* Records the global object, the intrinsic prototypes and constructors,
+   the objects held by global properties (namespaces such as Math) and
+   the prototypes and constructors reachable from them. Mutations of
+   deeper objects are not tracked. */
+JSContextSnapshot *JS_NewContextSnapshot(JSContext *ctx)
+{
+    JSContextSnapshot *snap;
+    JSObject *p;
+    JSShapeProperty *prs;
+    uint32_t i;
+    int j, ret = 0;
+
+    snap = js_mallocz(ctx, sizeof(*snap));
+    if (!snap)
+        return NULL;
+    snap->std_array_prototype = ctx->std_array_prototype;
+
+    ret |= js_context_snapshot_add(ctx, snap, ctx->global_obj);
+    for(i = 0; i < ctx->rt->class_count; i++)
+        ret |= js_context_snapshot_add(ctx, snap, ctx->class_proto[i]);
+    for(i = 0; i < JS_NATIVE_ERROR_COUNT; i++)
+        ret |= js_context_snapshot_add(ctx, snap, ctx->native_error_proto[i]);
+    ret |= js_context_snapshot_add(ctx, snap, ctx->function_proto);
+    ret |= js_context_snapshot_add(ctx, snap, ctx->function_ctor);
+    ret |= js_context_snapshot_add(ctx, snap, ctx->array_ctor);
+    ret |= js_context_snapshot_add(ctx, snap, ctx->regexp_ctor);
+    ret |= js_context_snapshot_add(ctx, snap, ctx->promise_ctor);
+    ret |= js_context_snapshot_add(ctx, snap, ctx->iterator_ctor);
+    ret |= js_context_snapshot_add(ctx, snap, ctx->async_iterator_proto);
+    ret |= js_context_snapshot_add(ctx, snap, ctx->array_proto_values);
+    ret |= js_context_snapshot_add(ctx, snap, ctx->throw_type_error);
+    ret |= js_context_snapshot_add(ctx, snap, ctx->eval_obj);
+    if (ret)
+        goto fail;
+
+    /* the global object was recorded first: its lazy properties are
+       instantiated, as variable references */
+    p = JS_VALUE_GET_OBJ(ctx->global_obj);
+    for(i = 0, prs = get_shape_prop(p->shape); i < p->shape->prop_count; i++, prs++) {
+        JSValue val;
+        if (prs->atom == JS_ATOM_NULL)
+            continue;
+        if ((prs->flags & JS_PROP_TMASK) == JS_PROP_VARREF)
+            val = *p->prop[i].u.var_ref->pvalue;
+        else if ((prs->flags & JS_PROP_TMASK) == 0)
+            val = p->prop[i].u.value;
+        else
+            continue;
+        if (js_context_snapshot_add(ctx, snap, val))
+            goto fail;
+    }
+
+    /* intrinsics that are only reachable through a recorded object, such
+       as %TypedArray% or the GeneratorFunction constructor: follow the
+       prototypes and the 'constructor' properties until no new object is
+       found */
+    for(j = 0; j < snap->count; j++) {
+        JSObjectSnapshot *os = &snap->objs[j];
+        JSValue proto, ctor = JS_UNDEFINED;
+        proto = os->proto;
+        for(i = 0; i < os->prop_count; i++) {
+            if (os->props[i].atom == JS_ATOM_constructor &&
+                (os->props[i].flags & JS_PROP_TMASK) == 0) {
+                ctor = os->props[i].value;
+                break;
+            }
+        }
+        /* 'os' is invalidated by the first add */
+        if (js_context_snapshot_add(ctx, snap, proto) ||
+            js_context_snapshot_add(ctx, snap, ctor))
+            goto fail;
+    }
+    return snap;
+ fail:
+    JS_FreeContextSnapshot(ctx, snap);
+    return NULL;
+}
+
+void JS_FreeContextSnapshot(JSContext *ctx, JSContextSnapshot *snap)
+{
+    int i;
+
+    if (!snap)
+        return;
+    for(i = 0; i < snap->count; i++) {
+        js_object_snapshot_free(ctx, &snap->objs[i]);
+        JS_FreeValue(ctx, snap->objs[i].obj);
+    }
+    js_free(ctx, snap->objs);
+    js_free(ctx, snap);
+}
+
+/* restore the value of a property whose flags match the snapshot */
+static void js_property_snapshot_restore(JSContext *ctx, JSProperty *pr,
+                                         const JSPropertySnapshot *ps)
+{
+    JSObject *getter, *setter;
+
+    switch(ps->flags & JS_PROP_TMASK) {
+    case 0:
+        if (!js_same_value(ctx, pr->u.value, ps->value))
+            set_value(ctx, &pr->u.value, JS_DupValue(ctx, ps->value));
+        break;
+    case JS_PROP_GETSET:
+        getter = JS_IsUndefined(ps->value) ? NULL : JS_VALUE_GET_OBJ(ps->value);
+        setter = JS_IsUndefined(ps->setter) ? NULL : JS_VALUE_GET_OBJ(ps->setter);
+        if (pr->u.getset.getter != getter || pr->u.getset.setter != setter) {
+            free_property(ctx->rt, pr, JS_PROP_GETSET);
+            pr->u.getset.getter = getter;
+            pr->u.getset.setter = setter;
+            if (getter)
+                JS_DupValue(ctx, ps->value);
+            if (setter)
+                JS_DupValue(ctx, ps->setter);
+        }
+        break;
+    case JS_PROP_VARREF:
+        if (!js_same_value(ctx, *pr->u.var_ref->pvalue, ps->value))
+            set_value(ctx, pr->u.var_ref->pvalue, JS_DupValue(ctx, ps->value));
+        pr->u.var_ref->is_const = !(ps->flags & JS_PROP_WRITABLE);
+        break;
+    default:
+        break;
+    }
+}
+
+/* Fast path when the object kept its layout: only values can differ.
+   Return FALSE if the slow path is needed. */
+static BOOL js_object_snapshot_restore_values(JSContext *ctx,
+                                              JSObjectSnapshot *os)
+{
+    JSObject *p = JS_VALUE_GET_OBJ(os->obj);
+    JSShapeProperty *prs;
+    uint32_t i;
+
+    if (p->shape->prop_count != os->prop_count ||
+        p->extensible != os->extensible ||
+        JS_VALUE_GET_PTR(os->proto) != (void *)p->shape->proto ||
+        (p->fast_array && p->u.array.count != 0))
+        return FALSE;
+    /* unhashed shapes are updated in place: compare the layout */
+    prs = get_shape_prop(p->shape);
+    for(i = 0; i < os->prop_count; i++) {
+        if (prs[i].atom != os->props[i].atom ||
+            prs[i].flags != os->props[i].flags)
+            return FALSE;
+    }
+    for(i = 0; i < os->prop_count; i++) {
+        if (prs[i].atom != JS_ATOM_NULL)
+            js_property_snapshot_restore(ctx, &p->prop[i], &os->props[i]);
+    }
+    return TRUE;
+}
+
+/* make a property configurable so that it can be deleted or redefined */
+static int js_force_configurable(JSContext *ctx, JSObject *p, JSAtom atom)
+{
+    JSShapeProperty *prs;
+    JSProperty *pr;
+
+    prs = find_own_property(&pr, p, atom);
+    if (!prs || (prs->flags & JS_PROP_CONFIGURABLE))
+        return 0;
+    if (js_shape_prepare_update(ctx, p, &prs))
+        return -1;
+    prs->flags |= JS_PROP_CONFIGURABLE;
+    return 0;
+}
+
+static int js_object_snapshot_restore(JSContext *ctx, JSObjectSnapshot *os)
+{
+    JSObject *p = JS_VALUE_GET_OBJ(os->obj);
+    JSPropertySnapshot *ps;
+    JSPropertyEnum *tab;
+    JSShapeProperty *prs;
+    JSProperty *pr;
+    uint32_t len, i, j;
+    int ret, flags;
+
+    if (js_object_snapshot_restore_values(ctx, os))
+        return 0;
+
+    p->extensible = TRUE;
+    if (JS_SetPrototypeInternal(ctx, os->obj, os->proto, TRUE) < 0)
+        return -1;
+
+    /* drop the properties that were added */
+    if (JS_GetOwnPropertyNamesInternal(ctx, &tab, &len, p,
+                                       JS_GPN_STRING_MASK | JS_GPN_SYMBOL_MASK |
+                                       JS_GPN_PRIVATE_MASK))
+        return -1;
+    ret = 0;
+    for(i = 0; i < len && ret == 0; i++) {
+        for(j = 0; j < os->prop_count; j++) {
+            if (os->props[j].atom == tab[i].atom)
+                break;
+        }
+        if (j < os->prop_count)
+            continue;
+        if (js_force_configurable(ctx, p, tab[i].atom) ||
+            delete_property(ctx, p, tab[i].atom) < 0)
+            ret = -1;
+    }
+    JS_FreePropertyEnum(ctx, tab, len);
+    if (ret)
+        return -1;
+
+    /* restore the recorded properties, in place when their kind is
+       unchanged so that special properties such as the array length keep
+       their internal representation */
+    for(i = 0; i < os->prop_count; i++) {
+        ps = &os->props[i];
+        if (ps->atom == JS_ATOM_NULL)
+            continue;
+        prs = find_own_property(&pr, p, ps->atom);
+        if (prs && (prs->flags & JS_PROP_TMASK) == (ps->flags & JS_PROP_TMASK)) {
+            if (prs->flags != ps->flags) {
+                if (js_shape_prepare_update(ctx, p, &prs))
+                    return -1;
+                prs->flags = ps->flags;
+            }
+            js_property_snapshot_restore(ctx, pr, ps);
+            continue;
+        }
+        if (prs && (js_force_configurable(ctx, p, ps->atom) ||
+                    delete_property(ctx, p, ps->atom) < 0))
+            return -1;
+        flags = (ps->flags & JS_PROP_C_W_E) | JS_PROP_HAS_CONFIGURABLE |
+            JS_PROP_HAS_ENUMERABLE | JS_PROP_THROW;
+        if ((ps->flags & JS_PROP_TMASK) == JS_PROP_GETSET) {
+            flags |= JS_PROP_HAS_GET | JS_PROP_HAS_SET;
+            ret = JS_DefineProperty(ctx, os->obj, ps->atom, JS_UNDEFINED,
+                                    ps->value, ps->setter, flags);
+        } else {
+            flags |= JS_PROP_HAS_VALUE | JS_PROP_HAS_WRITABLE;
+            ret = JS_DefineProperty(ctx, os->obj, ps->atom, ps->value,
+                                    JS_UNDEFINED, JS_UNDEFINED, flags);
+        }
+        if (ret < 0)
+            return -1;
+    }
+    p->extensible = os->extensible;
+
+    /* the object is now equivalent to the snapshot: record its new layout
+       so that the next restore can take the fast path */
+    js_object_snapshot_free(ctx, os);
+    return js_object_snapshot_record(ctx, os);
+}
+
+/* Restores the recorded objects, drops the global lexical variables, the
+   loaded modules and the pending jobs of the context. On failure the
+   context is in an unspecified state and should be freed. */
+int JS_RestoreContextSnapshot(JSContext *ctx, JSContextSnapshot *snap)
+{
+    JSRuntime *rt = ctx->rt;
+    JSObject *p;
+    JSValue obj;
+    uint32_t j, n;
+    int i;
+
+    /* compact the job ring, keeping the order of the other jobs */
+    n = 0;
+    for(j = 0; j < rt->job_count; j++) {
+        JSJobEntry *e = &rt->job_ring[(rt->job_head + j) & (rt->job_size - 1)];
+        if (e->realm == ctx) {
+            js_free_job_args(rt, e);
+            JS_FreeContext(ctx);
+        } else {
+            rt->job_ring[(rt->job_head + n++) & (rt->job_size - 1)] = *e;
+        }
+    }
+    rt->job_count = n;
+
+    js_free_modules(ctx, JS_FREE_MODULE_ALL);
+
+    for(i = 0; i < snap->count; i++) {
+        if (js_object_snapshot_restore(ctx, &snap->objs[i]))
+            return -1;
+    }
+    ctx->std_array_prototype = snap->std_array_prototype;
+
+    /* references from previous code to global variables stay valid but
+       are no longer reachable from the global scope */
+    obj = JS_NewObjectProtoClassAlloc(ctx, JS_NULL, JS_CLASS_OBJECT, 16);
+    if (JS_IsException(obj))
+        return -1;
+    set_value(ctx, &ctx->global_var_obj, obj);
+    obj = JS_NewObjectProtoClassAlloc(ctx, JS_NULL, JS_CLASS_OBJECT, 4);
+    if (JS_IsException(obj))
+        return -1;
+    p = JS_VALUE_GET_OBJ(ctx->global_obj);
+    set_value(ctx, &p->u.global_object.uninitialized_vars, obj);
+    return 0;
+}
+
+/* Interrupts */
+
+void JS_SetInterruptInterval(JSRuntime *rt, int interval)
+{
+    if (interval <= 0)
+        interval = JS_INTERRUPT_COUNTER_INIT;
+    rt->interrupt_interval = interval;
+}
+
+/* Context memory accounting */
+
+/* make the next interrupt poll of 'ctx' call the handler, without
+   charging the skipped ticks as fuel */
+static void js_request_interrupt_poll(JSContext *ctx)
+{
+    ctx->interrupt_counter_start -= ctx->interrupt_counter;
+    ctx->interrupt_counter = 0;
+}
+
+int JS_SetContextMemoryLimits(JSContext *ctx, int64_t soft_limit,
+                              int64_t hard_limit)
+{
+    JSMemoryAccount *acc = ctx->account;
+    if (!acc)
+        return -1;
+    acc->soft_limit = max_int64(soft_limit, 0);
+    acc->hard_limit = max_int64(hard_limit, 0);
+    if (acc->soft_limit && acc->malloc_size > acc->soft_limit)
+        js_request_interrupt_poll(ctx);
+    return 0;
+}
+
+int JS_GetContextMemoryUsage(JSContext *ctx, JSContextMemoryUsage *s)
+{
+    JSMemoryAccount *acc = ctx->account;
+    if (!acc)
+        return -1;
+    s->malloc_size = acc->malloc_size;
+    s->malloc_count = acc->malloc_count;
+    s->soft_limit = acc->soft_limit;
+    s->hard_limit = acc->hard_limit;
+    return 0;
+}
+
+/* Fuel metering */
+
+void JS_SetFuel(JSContext *ctx, int64_t fuel)
+{
+    js_fuel_sync(ctx);
+    ctx->fuel = fuel < 0 ? -1 : fuel;
+    js_fuel_arm(ctx);
+}
+
+int64_t JS_GetFuel(JSContext *ctx)
+{
+    int64_t fuel;
+    if (ctx->fuel < 0)
+        return -1;
+    fuel = ctx->fuel - (ctx->interrupt_counter_start - ctx->interrupt_counter);
+    return max_int64(fuel, 0);
+}
+
+int64_t JS_GetFuelUsed(JSContext *ctx)
+{
+    return ctx->fuel_used +
+        (ctx->interrupt_counter_start - ctx->interrupt_counter);
+}
+
+/* Runtime images */
+
+static int js_performance_init_origin(JSContext *ctx);
+static int fill_secure_random_bytes(JSContext *ctx, uint8_t *buffer, size_t length);
+
+/* A runtime image is a copy of the whole linear memory taken by the
+   embedder. Addresses are offsets into that memory, so an image restored
+   into a fresh instance of the same module needs no relocation; only the
+   state that must differ between clones is refreshed on resume. */
+int JS_PrepareRuntimeImage(JSRuntime *rt)
+{
+    if (rt->current_stack_frame != NULL)
+        return -1;
+    JS_RunGC(rt);
+    return 0;
+}
+
+int JS_ResumeRuntimeImage(JSRuntime *rt)
+{
+    struct list_head *el;
+    JSContext *ctx;
+
+    list_for_each(el, &rt->context_list) {
+        ctx = list_entry(el, JSContext, link);
+        /* clones must not share the Math.random() sequence */
+        if (fill_secure_random_bytes(ctx, (uint8_t *)&ctx->random_state,
+                                     sizeof(ctx->random_state)) < 0)
+            js_random_init(ctx);
+        if (ctx->random_state == 0)
+            ctx->random_state = 1;
+        if (js_performance_init_origin(ctx) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* Asynchronous module loading */
+
+void JS_SetModuleImportHook(JSRuntime *rt, JSModuleImportHook *hook,
+                            void *opaque)
+{
+    rt->module_import_hook = hook;
+    rt->module_import_opaque = opaque;
+}
+
+char *JS_NormalizeModuleName(JSContext *ctx, const char *base_name,
+                             const char *name)
+{
+    JSRuntime *rt = ctx->rt;
+
+    if (!rt->module_normalize_func)
+        return js_default_module_normalize_name(ctx, base_name, name);
+    return rt->module_normalize_func(ctx, base_name, name,
+                                     rt->module_loader_opaque);
+}
+
+JSModuleDef *JS_FindLoadedModule(JSContext *ctx, const char *name)
+{
+    JSModuleDef *m;
+    JSAtom atom;
+
+    atom = JS_NewAtom(ctx, name);
+    if (atom == JS_ATOM_NULL)
+        return NULL;
+    m = js_find_loaded_module(ctx, atom);
+    JS_FreeAtom(ctx, atom);
+    return m;
+}
+
+/* load 'filename' and settle 'resolving_funcs' with its namespace once
+   evaluated, as import() does */
+void JS_LoadModuleWithFuncs(JSContext *ctx, const char *basename,
+                            const char *filename,
+                            JSValueConst *resolving_funcs)
+{
+    JS_LoadModuleInternal(ctx, basename, filename, resolving_funcs,
+                          JS_UNDEFINED);
+}
+
+int JS_GetModuleRequestCount(JSModuleDef *m)
+{
+    return m->req_module_entries_count;
+}
+
+/* return the specifier of the idx-th static import of 'm' as written in
+   the source, or JS_ATOM_NULL if out of range */
+JSAtom JS_GetModuleRequest(JSContext *ctx, JSModuleDef *m, int idx)
+{
+    if (idx < 0 || idx >= m->req_module_entries_count)
+        return JS_ATOM_NULL;
+    return JS_DupAtom(ctx, m->req_module_entries[idx].module_name);
+}
+
+/* Import scanning */
+
+/* 's->token' follows 'import' or 'export' at the top level. Return 1 if a
+   module request was reported, 0 if the statement is not one and -1 on
+   error. 's->token' is left on the first token not consumed. */
+static int js_scan_module_request(JSParseState *s, BOOL is_import,
+                                  JSModuleImportScanFunc *cb, void *opaque)
+{
+    const char *str;
+    int depth, tok, ret;
+
+    tok = s->token.val;
+    if (is_import) {
+        /* import() and import.meta */
+        if (tok == '(' || tok == '.')
+            return 0;
+        if (tok == TOK_STRING)
+            goto report;
+    } else if (tok != '*' && tok != '{') {
+        /* exported declaration */
+        return 0;
+    }
+    depth = 0;
+    for (;;) {
+        tok = s->token.val;
+        if (tok == TOK_EOF)
+            return 0;
+        if (depth == 0) {
+            if (token_is_pseudo_keyword(s, JS_ATOM_from)) {
+                if (next_token(s))
+                    return -1;
+                if (s->token.val == TOK_STRING)
+                    goto report;
+                /* 'from' was a binding name */
+                continue;
+            }
+            if (tok != TOK_IDENT && tok != TOK_STRING && tok != '*' &&
+                tok != ',' && tok != '{')
+                return 0;
+        }
+        if (tok == '{')
+            depth++;
+        else if (tok == '}')
+            depth--;
+        if (next_token(s))
+            return -1;
+    }
+ report:
+    str = JS_ToCString(s->ctx, s->token.u.str.str);
+    if (!str)
+        return -1;
+    ret = cb(s->ctx, str, opaque);
+    JS_FreeCString(s->ctx, str);
+    if (ret < 0 || next_token(s))
+        return -1;
+    return 1;
+}
+
+/* Pre-parse of module source that only runs the tokenizer: 'cb' is
+   called with the specifier of each static import and re-export, in
+   source order. As with js_parse_skip_parens_token(), regexps are told
+   from divisions by the previous token, so the result is a hint: the
+   compiler stays the authority on what a module imports. 'input' must
+   be NUL terminated. Return the number of specifiers or -1 on error. */
+int JS_ScanModuleImports(JSContext *ctx, const char *input, size_t input_len,
+                         const char *filename, JSModuleImportScanFunc *cb,
+                         void *opaque)
+{
+    JSParseState s1, *s = &s1;
+    JSFunctionDef fd;
+    char state[256];
+    size_t level = 0;
+    int last_tok = 0, tok_len, count = 0, ret;
+
+    js_parse_init(ctx, s, input, input_len, filename);
+    /* the tokenizer only looks at the mode of the current function */
+    memset(&fd, 0, sizeof(fd));
+    fd.js_mode = JS_MODE_STRICT;
+    s->cur_func = &fd;
+    s->is_module = TRUE;
+    skip_shebang(&s->buf_ptr, s->buf_end);
+    if (next_token(s))
+        goto fail;
+    for (;;) {
+        switch(s->token.val) {
+        case TOK_EOF:
+            goto done;
+        case '(':
+        case '[':
+        case '{':
+            if (level >= sizeof(state)) {
+                js_parse_error(s, "too many nested blocks");
+                goto fail;
+            }
+            state[level++] = s->token.val;
+            break;
+        case ')':
+        case ']':
+            if (level > 0)
+                level--;
+            break;
+        case '}':
+            if (level > 0 && state[--level] == '`') {
+                /* continue the parsing of the template */
+                free_token(s, &s->token);
+                s->got_lf = FALSE;
+                if (js_parse_template_part(s, s->buf_ptr))
+                    goto fail;
+                goto handle_template;
+            }
+            break;
+        case TOK_TEMPLATE:
+        handle_template:
+            if (s->token.u.str.sep != '`') {
+                if (level >= sizeof(state)) {
+                    js_parse_error(s, "too many nested blocks");
+                    goto fail;
+                }
+                state[level++] = '`';
+            }
+            break;
+        case TOK_DIV_ASSIGN:
+            tok_len = 2;
+            goto parse_regexp;
+        case '/':
+            tok_len = 1;
+        parse_regexp:
+            if (is_regexp_allowed(last_tok)) {
+                s->buf_ptr -= tok_len;
+                if (js_parse_regexp(s))
+                    goto fail;
+            }
+            break;
+        case TOK_IMPORT:
+        case TOK_EXPORT:
+            if (level == 0 && last_tok != '.' &&
+                last_tok != TOK_QUESTION_MARK_DOT) {
+                BOOL is_import = (s->token.val == TOK_IMPORT);
+                if (next_token(s))
+                    goto fail;
+                ret = js_scan_module_request(s, is_import, cb, opaque);
+                if (ret < 0)
+                    goto fail;
+                count += ret;
+                /* the current token has not been looked at */
+                last_tok = ret ? TOK_STRING : TOK_IDENT;
+                continue;
+            }
+            break;
+        }
+        last_tok = s->token.val;
+        if (next_token(s))
+            goto fail;
+    }
+ done:
+    free_token(s, &s->token);
+    return count;
+ fail:
+    free_token(s, &s->token);
+    return -1;
+}
+
+/* Lazy function compilation */
+
+/* Compile the body of the lazy function 'b' from its saved source. The
+   function is reparsed inside a wrapper function whose closure
+   variables mirror the ones of the stub, so the compiled function gets
+   the same closure variable layout and uses the variable references of
+   the existing closures. The result is kept in b->cpool[0]. */
+static JSFunctionBytecode *js_compile_lazy_function(JSContext *ctx,
+                                                    JSFunctionBytecode *b)
+{
+    JSParseState s1, *s = &s1;
+    JSFunctionDef *fd, *child;
+    JSFunctionBytecode *b1;
+    JSClosureVar *cv;
+    JSClosureTypeEnum closure_type;
+    JSValue fun_obj, bfunc;
+    const char *filename;
+    int i, idx, line_num, col_num;
+
+    if (JS_VALUE_GET_TAG(b->cpool[0]) == JS_TAG_FUNCTION_BYTECODE)
+        return JS_VALUE_GET_PTR(b->cpool[0]);
+
+    line_num = find_line_num(ctx, b, -1, &col_num);
+    filename = JS_AtomToCString(ctx, b->debug.filename);
+    if (!filename)
+        return NULL;
+    js_parse_init(ctx, s, b->debug.source, b->debug.source_len, filename);
+    /* the source starts at the position of the function */
+    s->get_line_col_cache.line_num = line_num - 1;
+    s->get_line_col_cache.col_num = col_num - 1;
+    s->lazy_compile = TRUE;
+
+    fd = js_new_function_def(ctx, NULL, TRUE, FALSE, filename,
+                             s->buf_start, &s->get_line_col_cache);
+    if (!fd)
+        goto fail1;
+    s->cur_func = fd;
+    fd->eval_type = JS_EVAL_TYPE_DIRECT;
+    fd->js_mode = b->js_mode;
+    fd->func_name = JS_DupAtom(ctx, JS_ATOM__eval_);
+    for(i = 0; i < b->closure_var_count; i++) {
+        cv = &b->closure_var[i];
+        if (cv->closure_type == JS_CLOSURE_GLOBAL_REF)
+            closure_type = JS_CLOSURE_GLOBAL_REF;
+        else
+            closure_type = JS_CLOSURE_REF;
+        if (add_closure_var(ctx, fd, closure_type, i, cv->var_name,
+                            cv->is_const, cv->is_lexical, cv->var_kind) < 0)
+            goto fail;
+    }
+    push_scope(s); /* body scope */
+    fd->body_scope = fd->scope_level;
+
+    if (next_token(s))
+        goto fail;
+    if (js_parse_function_decl2(s, JS_PARSE_FUNC_EXPR, JS_FUNC_NORMAL,
+                                JS_ATOM_NULL, s->token.ptr,
+                                JS_PARSE_EXPORT_NONE, &child))
+        goto fail;
+    if (s->token.val != TOK_EOF) {
+        js_parse_error(s, "unexpected token after the function body");
+        goto fail;
+    }
+    emit_op(s, OP_return);
+
+    /* a declaration is not bound to its name inside its body */
+    child->is_func_expr = b->lazy_func_expr;
+    /* resolve the free variables of the body to the closure variables
+       of the stub, in the same order */
+    for(i = 0; i < fd->closure_var_count; i++) {
+        cv = &fd->closure_var[i];
+        if (add_closure_var(ctx, child, cv->closure_type, i, cv->var_name,
+                            cv->is_const, cv->is_lexical, cv->var_kind) < 0)
+            goto fail;
+    }
+    idx = child->parent_cpool_idx;
+
+    fun_obj = js_create_function(ctx, fd);
+    if (JS_IsException(fun_obj))
+        goto fail1;
+    b1 = JS_VALUE_GET_PTR(fun_obj);
+    bfunc = JS_DupValue(ctx, b1->cpool[idx]);
+    JS_FreeValue(ctx, fun_obj);
+    JS_FreeCString(ctx, filename);
+
+    b1 = JS_VALUE_GET_PTR(bfunc);
+    if (b1->closure_var_count != b->closure_var_count) {
+        /* the body does not resolve its variables as the stub */
+        JS_FreeValue(ctx, bfunc);
+        JS_ThrowInternalError(ctx, "lazy function: unresolved variable");
+        return NULL;
+    }
+    for(i = 0; i < b1->closure_var_count; i++) {
+        b1->closure_var[i].closure_type = b->closure_var[i].closure_type;
+        b1->closure_var[i].var_idx = b->closure_var[i].var_idx;
+    }
+    b->cpool[0] = bfunc;
+    ctx->rt->lazy_compiled_count++;
+    return b1;
+ fail:
+    free_token(s, &s->token);
+    js_free_function_def(ctx, fd);
+ fail1:
+    JS_FreeCString(ctx, filename);
+    return NULL;
+}
+
+/* Replace the lazy bytecode of the function object 'p' by its compiled
+   body. Return the new bytecode or NULL on exception. */
+static JSFunctionBytecode *js_function_resolve_lazy(JSContext *ctx, JSObject *p)
+{
+    JSFunctionBytecode *b = p->u.func.function_bytecode;
+    JSFunctionBytecode *b1;
+
+    b1 = js_compile_lazy_function(b->realm, b);
+    if (!b1)
+        return NULL;
+    JS_DupValue(ctx, JS_MKPTR(JS_TAG_FUNCTION_BYTECODE, b1));
+    p->u.func.function_bytecode = b1;
+    JS_FreeValue(ctx, JS_MKPTR(JS_TAG_FUNCTION_BYTECODE, b));
+    return b1;
+}
+
+/* When enabled, the strict mode functions with a simple parameter list
+   compiled afterwards are only parsed and get their variables
+   resolved: their body is compiled on their first call. Syntax errors
+   are still reported at parse time. The function source must be kept
+   (see JS_SetStripInfo()). */
+void JS_SetLazyFunctions(JSRuntime *rt, JS_BOOL enable)
+{
+    rt->lazy_functions = (enable != 0);
+}
+
+void JS_GetLazyFunctionStats(JSRuntime *rt, JSLazyFunctionStats *s)
+{
+    s->skipped_count = rt->lazy_skipped_count;
+    s->compiled_count = rt->lazy_compiled_count;
+}
+
+
 /* Performance API */
 
 static JSValue js_performance_now(JSContext *ctx, JSValueConst this_val,
@@ -59782,7 +62245,8 @@ static const JSCFunctionListEntry js_performance_obj[] = {
                      JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE),
 };
 
-int JS_AddIntrinsicPerformance(JSContext *ctx) {
+static int js_performance_init_origin(JSContext *ctx)
+{
 #ifdef __wasi__
     __wasi_errno_t err;
     __wasi_timestamp_t monotonic_now;
@@ -59812,7 +62276,12 @@ int JS_AddIntrinsicPerformance(JSContext *ctx) {
     }
     ctx->time_origin_epoch_ms = (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0;
 #endif
-    
+    return 0;
+}
+
+int JS_AddIntrinsicPerformance(JSContext *ctx) {
+    if (js_performance_init_origin(ctx))
+        return -1;
    return JS_SetPropertyFunctionList(ctx, ctx->global_obj, js_performance_obj,
                                    countof(js_performance_obj));
 }
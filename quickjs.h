@@ -346,6 +346,9 @@ static inline JSValue __JS_NewShortBigInt(JSContext *ctx, int64_t d)
 #define JS_EVAL_FLAG_ASYNC (1 << 7)
 /* strip type information from source code */
 #define JS_EVAL_FLAG_STRIP_TYPES (1 << 8)
+/* with JS_EVAL_FLAG_COMPILE_ONLY, do not load the imports of a module.
+   They are resolved when the module is evaluated. */
+#define JS_EVAL_FLAG_NO_RESOLVE (1 << 9)
 
 typedef JSValue JSCFunction(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
 typedef JSValue JSCFunctionMagic(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int magic);
@@ -391,6 +394,10 @@ void JS_FreeContext(JSContext *s);
 JSContext *JS_DupContext(JSContext *ctx);
 void *JS_GetContextOpaque(JSContext *ctx);
 void JS_SetContextOpaque(JSContext *ctx, void *opaque);
+/* called when the last reference to a context is released, before it
+   is freed */
+typedef void JSContextFinalizer(JSContext *ctx);
+void JS_SetContextFinalizer(JSRuntime *rt, JSContextFinalizer *finalizer);
 JSRuntime *JS_GetRuntime(JSContext *ctx);
 void JS_SetClassProto(JSContext *ctx, JSClassID class_id, JSValue obj);
 JSValue JS_GetClassProto(JSContext *ctx, JSClassID class_id);
@@ -1185,6 +1192,73 @@ JSValue JS_NewTypedArrayWithBuffer(JSContext *ctx, JSValueConst buffer,
                                    uint32_t byte_offset, uint32_t length,
                                    JSTypedArrayEnum type);
 
+JSValue JS_NewStringLatin1(JSContext *ctx, const uint8_t *buf, size_t len);
+JSValue JS_NewStringUTF16(JSContext *ctx, const uint16_t *buf, size_t len);
+JSValue JS_NewStringBuffer(JSContext *ctx, size_t len, JS_BOOL is_wide_char,
+                           void **pbuf);
+const void *JS_GetStringView(JSContext *ctx, JSValue *pval, uint32_t *plen,
+                             JS_BOOL *pis_wide_char);
+
+typedef struct JSContextSnapshot JSContextSnapshot;
+JSContextSnapshot *JS_NewContextSnapshot(JSContext *ctx);
+int JS_RestoreContextSnapshot(JSContext *ctx, JSContextSnapshot *snap);
+void JS_FreeContextSnapshot(JSContext *ctx, JSContextSnapshot *snap);
+
+JSContext *JS_GetPendingJobContext(JSRuntime *rt);
+
+void JS_SetInterruptInterval(JSRuntime *rt, int interval);
+
+void JS_SetFuel(JSContext *ctx, int64_t fuel);
+int64_t JS_GetFuel(JSContext *ctx);
+int64_t JS_GetFuelUsed(JSContext *ctx);
+
+typedef struct JSContextMemoryUsage {
+    int64_t malloc_size;
+    int64_t malloc_count;
+    int64_t soft_limit;
+    int64_t hard_limit;
+} JSContextMemoryUsage;
+/* contexts of such a runtime charge their allocations to themselves */
+JSRuntime *JS_NewRuntimeWithContextAccounting(void);
+int JS_SetContextMemoryLimits(JSContext *ctx, int64_t soft_limit,
+                              int64_t hard_limit);
+int JS_GetContextMemoryUsage(JSContext *ctx, JSContextMemoryUsage *s);
+
+int JS_PrepareRuntimeImage(JSRuntime *rt);
+int JS_ResumeRuntimeImage(JSRuntime *rt);
+
+/* called by import() before the module is loaded synchronously. Return 1
+   to let the engine load it, 0 if the hook settles the promise later
+   through 'resolving_funcs' (it must duplicate them) or -1 on exception. */
+typedef int JSModuleImportHook(JSContext *ctx, const char *base_name,
+                               const char *name, JSValueConst attributes,
+                               JSValueConst *resolving_funcs, void *opaque);
+void JS_SetModuleImportHook(JSRuntime *rt, JSModuleImportHook *hook,
+                            void *opaque);
+/* the result must be freed with js_free() */
+char *JS_NormalizeModuleName(JSContext *ctx, const char *base_name,
+                             const char *name);
+JSModuleDef *JS_FindLoadedModule(JSContext *ctx, const char *name);
+void JS_LoadModuleWithFuncs(JSContext *ctx, const char *basename,
+                            const char *filename,
+                            JSValueConst *resolving_funcs);
+int JS_GetModuleRequestCount(JSModuleDef *m);
+JSAtom JS_GetModuleRequest(JSContext *ctx, JSModuleDef *m, int idx);
+
+/* return < 0 to stop the scan with an exception */
+typedef int JSModuleImportScanFunc(JSContext *ctx, const char *specifier,
+                                   void *opaque);
+int JS_ScanModuleImports(JSContext *ctx, const char *input, size_t input_len,
+                         const char *filename, JSModuleImportScanFunc *cb,
+                         void *opaque);
+
+typedef struct JSLazyFunctionStats {
+    int64_t skipped_count; /* functions whose compilation was deferred */
+    int64_t compiled_count; /* deferred functions compiled on call */
+} JSLazyFunctionStats;
+void JS_SetLazyFunctions(JSRuntime *rt, JS_BOOL enable);
+void JS_GetLazyFunctionStats(JSRuntime *rt, JSLazyFunctionStats *s);
+
 /* @END_Hako */
 
 #undef js_unlikely
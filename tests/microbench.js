@@ -268,6 +268,37 @@ function prop_update(n)
     return n * 4;
 }
 
+function prop_proto_read(n)
+{
+    var obj, proto, sum, j;
+    proto = { a: 1, b: 2, c:3, d:4 };
+    obj = Object.create(proto);
+    obj.x = 0;
+    sum = 0;
+    for(j = 0; j < n; j++) {
+        sum += obj.a;
+        sum += obj.b;
+        sum += obj.c;
+        sum += obj.d;
+    }
+    global_res = sum;
+    return n * 4;
+}
+
+function prop_poly_read(n)
+{
+    var tab, obj, sum, j;
+    tab = [ { a: 1, b: 2 }, { b: 2, a: 1 }, { x: 0, a: 1, b: 2 } ];
+    sum = 0;
+    for(j = 0; j < n; j++) {
+        obj = tab[j % 3];
+        sum += obj.a;
+        sum += obj.b;
+    }
+    global_res = sum;
+    return n * 2;
+}
+
 function prop_create(n)
 {
     var obj, i, j;
@@ -1393,6 +1424,8 @@ function main(argc, argv, g)
         prop_read,
         prop_write,
         prop_update,
+        prop_proto_read,
+        prop_poly_read,
         prop_create,
         prop_clone,
         prop_delete,
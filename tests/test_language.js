@@ -664,6 +664,325 @@ function test_global_var_opt()
     assert(gvar1, 5);
 }
 
+/* calls from bytecode to bytecode functions, which run in the
+   interpreter loop of the caller with CONFIG_INLINE_CALL */
+function test_calls()
+{
+    var d = 0;
+
+    function fib(n) { return n < 2 ? n : fib(n - 1) + fib(n - 2); }
+    assert(fib(20), 6765);
+
+    /* missing and extra arguments */
+    function few(a, b, c) { return [a, b, c, arguments.length].join(); }
+    assert(few(1), "1,,,1");
+    assert(few(1, 2, 3, 4, 5), "1,2,3,5");
+    function rest(a, ...r) { return r.length; }
+    assert(rest(1, 2, 3), 2);
+    function mapped(a) { arguments[0] = 5; return a; }
+    assert(mapped(1), 5);
+
+    /* this, methods, super and closures */
+    var o = { m(a) { return this === o && a; } };
+    assert(o.m(3), 3);
+    class A { f() { return 1; } }
+    class B extends A { f() { return super.f() + 1; } g() { return this.f(); } }
+    assert(new B().g(), 2);
+    function counter() { var x = 0; return function () { return ++x; }; }
+    var c = counter();
+    c();
+    assert(c(), 2);
+
+    /* exceptions thrown through several frames */
+    function thrower(n) {
+        if (n == 0)
+            throw new Error("deep");
+        return 1 + thrower(n - 1);
+    }
+    function mid(n) {
+        try {
+            return thrower(n);
+        } finally {
+            d = n;
+        }
+    }
+    try {
+        mid(100);
+        assert(false);
+    } catch(e) {
+        assert(e.message, "deep");
+        assert(d, 100);
+    }
+    function catcher(n) {
+        try {
+            return thrower(n);
+        } catch(e) {
+            return n;
+        }
+    }
+    function outer(n) { return catcher(n) + 1; }
+    assert(outer(50), 51);
+
+    /* the stack overflow is recoverable */
+    function inf() { return inf() + 1; }
+    assert_throws(InternalError, inf);
+    assert(fib(10), 55);
+
+    /* generators and constructors called from bytecode */
+    function* gen() { yield fib(5); yield outer(1); }
+    assert([...gen()].join(), "5,2");
+    function P(x) { this.x = x; this.nt = new.target === P; }
+    function make(x) { return new P(x); }
+    assert(make(4).x, 4);
+    assert(make(4).nt, true);
+}
+
+/* strict mode tail calls reuse the frame of the caller with
+   CONFIG_INLINE_CALL: run the deep cases only when the engine was built
+   with it (make CONFIG_INLINE_CALL=y test) */
+function test_tail_calls()
+{
+    "use strict";
+    var tail_calls = typeof scriptArgs != "undefined" &&
+        scriptArgs.indexOf("tail_calls") >= 0;
+    var n = tail_calls ? 1000000 : 500;
+    var o;
+
+    function sum(n, acc) {
+        if (n == 0)
+            return acc;
+        return sum(n - 1, acc + n);
+    }
+    assert(sum(n, 0), n * (n + 1) / 2);
+
+    function is_even(n) {
+        if (n == 0)
+            return true;
+        return is_odd(n - 1);
+    }
+    function is_odd(n) {
+        if (n == 0)
+            return false;
+        return is_even(n - 1);
+    }
+    assert(is_even(n), true);
+    assert(is_odd(n + 1), true);
+
+    o = {
+        m(n, acc) {
+            if (n == 0)
+                return acc;
+            return this.m(n - 1, acc + 1);
+        }
+    };
+    assert(o.m(n, 0), n);
+
+    /* tail calls between functions of different frame sizes */
+    function big(n, a1, a2, a3, a4, a5, a6, a7, a8) {
+        var v1 = a1, v2 = a2, v3 = a3;
+        if (n == 0)
+            return a8 + v1 + v2 + v3;
+        return small(n - 1);
+    }
+    function small(n) {
+        return big(n, 1, 2, 3, 4, 5, 6, 7, 8);
+    }
+    assert(small(n), 14);
+
+    function args(n) {
+        if (n == 0)
+            return arguments.length;
+        return args(n - 1, 1, 2, 3);
+    }
+    assert(args(n), 4);
+
+    /* an exception thrown at the bottom of a chain of tail calls */
+    function thrower(n) {
+        if (n == 0)
+            throw new Error("tail");
+        return thrower(n - 1);
+    }
+    try {
+        thrower(n);
+        assert(false);
+    } catch(e) {
+        assert(e.message, "tail");
+    }
+
+    /* the callee closure is kept alive by the reused frame */
+    function clos(n) {
+        var f = () => n;
+        if (n == 0)
+            return f;
+        return clos(n - 1);
+    }
+    assert(clos(n)(), 0);
+}
+
+/* instruction sequences shortened by the peephole optimizer */
+function test_peephole()
+{
+    var o, k;
+
+    (1, eval)("var gpeep;");
+    gpeep = 1;
+    gpeep = gpeep + 1;
+    assert(gpeep, 2);
+
+    function let_set() {
+        let a;
+        a = 3;
+        let b = a + 1;
+        return b * 2;
+    }
+    assert(let_set(), 8);
+    function let_tdz() {
+        a = 1;
+        let a;
+    }
+    assert_throws(ReferenceError, let_tdz);
+
+    o = { x: 1, ["y"]: 2, [1]: 3, [Symbol.iterator]: 4 };
+    k = Object.keys(o).join();
+    assert(k, "1,x,y");
+    assert(o["y"], 2);
+}
+
+/* add, sub and mul specialize themselves to float64 operands and go
+   back to the generic case when the operands change */
+function test_float_arith()
+{
+    var o, i, r, vals;
+
+    function add(a, b) { return a + b; }
+    function sub(a, b) { return a - b; }
+    function mul(a, b) { return a * b; }
+    function div(a, b) { return a / b; }
+
+    o = { valueOf() { return 4; } };
+    for(i = 0; i < 2; i++) {
+        assert(add(1, 2), 3);
+        assert(add(1.5, 2), 3.5);
+        assert(add(1, 2), 3);
+        assert(add(0x7fffffff, 1), 2147483648);
+        assert(add("a", 1), "a1");
+        assert(add(0.5, "b"), "0.5b");
+        assert(add(o, 0.5), 4.5);
+        assert(add(1n, 2n), 3n);
+        assert(add(0.25, 0.5), 0.75);
+        assert(add(-0, -0), -0);
+        assert(add(-0, 0), 0);
+        assert(add(NaN, 1.5), NaN);
+        assert_throws(TypeError, () => add(1.5, 1n));
+
+        assert(sub(1, 2), -1);
+        assert(sub(1.5, 2), -0.5);
+        assert(sub(-0, 0), -0);
+        assert(sub("3", 0.5), 2.5);
+        assert(sub(o, 1.5), 2.5);
+        assert(sub(3n, 1n), 2n);
+        assert(sub(2.5, 0.5), 2);
+
+        assert(mul(2, 3), 6);
+        assert(mul(1.5, 2), 3);
+        assert(mul(-1, 0), -0);
+        assert(mul(0.5, -0), -0);
+        assert(mul(0x10000, 0x10000), 4294967296);
+        assert(mul("2", 1.5), 3);
+        assert(mul(o, 0.25), 1);
+        assert(mul(2n, 3n), 6n);
+        assert(mul(Infinity, 0.5), Infinity);
+
+        assert(div(1, 2), 0.5);
+        assert(div(1.5, 0.5), 3);
+        assert(div(1, -0), -Infinity);
+        assert(div(o, 0.5), 8);
+        assert(div(7n, 2n), 3n);
+    }
+
+    /* a loop whose accumulator changes type */
+    vals = [ 1, 2.5, 3, "x", 4.5, o ];
+    r = 0;
+    for(i = 0; i < vals.length; i++)
+        r = r + vals[i];
+    assert(r, "6.5x4.54");
+    r = 0.5;
+    for(i = 0; i < 10; i++)
+        r = r * 2 - 1;
+    assert(r, -511);
+}
+
+/* with 'qjs --lazy-functions', the body of the strict mode functions
+   below is only compiled on their first call */
+function test_lazy_functions()
+{
+    var r;
+
+    r = (1, eval)(`"use strict";
+    (function () {
+        var log = [];
+        var v = 1;
+        let l = 2;
+        const c = 3;
+
+        function outer(a) {
+            var x = a * 10;
+            function inner(b) {
+                /* variables of two enclosing functions */
+                return x + b + v + l + c;
+            }
+            function set(n) { x = n; }
+            return [inner, set];
+        }
+        var fs = outer(1);
+        log.push(fs[0](1));             /* 10 + 1 + 1 + 2 + 3 */
+        fs[1](100);
+        log.push(fs[0](1));             /* the closure sees the new x */
+        v = 10;
+        log.push(fs[0](0));
+
+        /* hoisted declaration called before its definition */
+        log.push(hoisted(2));
+        function hoisted(n) { return n * c; }
+
+        /* named function expression */
+        var fact = function f(n) { return n <= 1 ? 1 : n * f(n - 1); };
+        log.push(fact(5));
+
+        /* direct eval inside a lazy function */
+        function ev(s) { var y = 7; return eval(s); }
+        log.push(ev("y + v"));
+
+        /* this, arguments and new */
+        function args() { return arguments.length + (this ? this.k : 0); }
+        log.push(args.call({ k: 10 }, 1, 2));
+        function Point(x) { this.x = x; }
+        log.push(new Point(4).x);
+
+        /* TDZ and const checks run when the body is compiled late */
+        function tdz() { return late; }
+        try { tdz(); log.push("no tdz"); } catch(e) { log.push(e.name); }
+        let late = 5;
+        log.push(tdz());
+        function set_const() { c = 4; }
+        try { set_const(); } catch(e) { log.push(e.name); }
+        function inc_const() { return function() { c++; }; }
+        try { inc_const()(); } catch(e) { log.push(e.name); }
+
+        log.push(String(hoisted).indexOf("n * c") > 0);
+        return log.join();
+    })();`);
+    assert(r, "17,107,115,6,120,17,12,4,ReferenceError,5,TypeError,TypeError,true");
+
+    /* syntax errors in bodies that are never called are reported */
+    assert_throws(SyntaxError, function() {
+        (1, eval)('"use strict"; function never() { var 1x; }');
+    });
+    assert_throws(SyntaxError, function() {
+        (1, eval)('"use strict"; function never() { with (a) {} }');
+    });
+}
+
 test_op1();
 test_cvt();
 test_eq();
@@ -690,3 +1009,8 @@ test_optional_chaining();
 test_parse_arrow_function();
 test_unicode_ident();
 test_global_var_opt();
+test_calls();
+test_tail_calls();
+test_peephole();
+test_float_arith();
+test_lazy_functions();
@@ -381,6 +381,100 @@ function test_cyclic_labels()
     }
 }
 
+/* comparisons followed by a conditional jump, which are fused into a
+   single instruction when the jump offset fits in 8 bits */
+function test_cmp_branch()
+{
+    var vals, i, j, a, b, r, o, log;
+
+    function cmp(a, b) {
+        var r = "";
+        if (a < b) r += "lt ";
+        if (a <= b) r += "lte ";
+        if (a > b) r += "gt ";
+        if (a >= b) r += "gte ";
+        if (a === b) r += "seq ";
+        if (a !== b) r += "sne ";
+        return r;
+    }
+    function cmp_ref(a, b) {
+        var r = "";
+        r += (a < b) ? "lt " : "";
+        r += (a <= b) ? "lte " : "";
+        r += (a > b) ? "gt " : "";
+        r += (a >= b) ? "gte " : "";
+        r += (a === b) ? "seq " : "";
+        r += (a !== b) ? "sne " : "";
+        return r;
+    }
+
+    vals = [ 0, -0, 1, -1, 1.5, 0x7fffffff, -0x80000000, 2 ** 53,
+             NaN, Infinity, -Infinity, undefined, null, true, "1", "a",
+             "b", 1n, -1n ];
+    for(i = 0; i < vals.length; i++) {
+        for(j = 0; j < vals.length; j++) {
+            a = vals[i];
+            b = vals[j];
+            assert(cmp(a, b), cmp_ref(a, b), String(a) + " cmp " + String(b));
+        }
+    }
+
+    assert(cmp(NaN, NaN), "sne ");
+    assert(cmp(1, NaN), "sne ");
+    assert(cmp(-0, 0), "lte gte seq ");
+    assert(cmp(0.5, 1), "lt lte sne ");
+    assert(cmp(1, 1.0), "lte gte seq ");
+
+    /* the conversions of the operands run in order, and once */
+    log = [];
+    o = { valueOf() { log.push("o"); return 1; } };
+    r = { valueOf() { log.push("r"); return 2; } };
+    if (o < r) log.push("lt");
+    assert(log.join(), "o,r,lt");
+    log = [];
+    if (o === o) log.push("seq");
+    assert(log.join(), "seq");
+
+    /* loops exit through the fused instruction */
+    r = 0;
+    for(i = 0.5; i < 10; i++)
+        r++;
+    assert(r, 10);
+    r = 0;
+    for(i = 0; i < NaN; i++)
+        r++;
+    assert(r, 0);
+    r = 0;
+    for(i = 10; i >= -0; i--)
+        r++;
+    assert(r, 11);
+}
+
+/* a fused compare and jump is only used when the jump offset fits in 8
+   bits: check the bodies around that limit */
+function test_cmp_branch_range()
+{
+    var n, f, g, body;
+
+    for(n = 30; n < 50; n++) {
+        body = "var x = 0;";
+        body += "if (a < b) {" + "x = x + 1;".repeat(n) + "}";
+        body += "return x;";
+        f = new Function("a", "b", body);
+        assert(f(1, 2), n, "taken " + n);
+        assert(f(2, 1), 0, "not taken " + n);
+        assert(f(NaN, 1), 0, "NaN " + n);
+        assert(f(0.5, 1), n, "float " + n);
+
+        body = "var x = 0, i = 0;";
+        body += "while (i !== a) {" + "x = x + 1;".repeat(n) + "i++; }";
+        body += "return x;";
+        g = new Function("a", body);
+        assert(g(2), 2 * n, "loop " + n);
+        assert(g(0), 0, "loop not taken " + n);
+    }
+}
+
 test_while();
 test_while_break();
 test_do_while();
@@ -400,3 +494,5 @@ test_try_catch5();
 test_try_catch6();
 test_try_catch7();
 test_try_catch8();
+test_cmp_branch();
+test_cmp_branch_range();
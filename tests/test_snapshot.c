@@ -0,0 +1,104 @@
+/*
+ * QuickJS: context snapshot test
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "../quickjs.h"
+#include "../cutils.h"
+
+/* each test mutates the context, which is then restored: 'check' must
+   evaluate to true in the restored context */
+static const struct {
+    const char *mutate;
+    const char *check;
+} tests[] = {
+    { "globalThis.leak = 1; var v = 2; let l = 3;",
+      "typeof leak === 'undefined' && typeof v === 'undefined' &&"
+      " typeof l === 'undefined'" },
+    { "Array.prototype.push = null; Object.freeze(Array.prototype);",
+      "typeof [].push === 'function' && Object.isExtensible(Array.prototype)" },
+    { "Math.max = () => 0; delete Math.min;",
+      "Math.max(1, 2) === 2 && Math.min(1, 2) === 1" },
+    { "Object.getPrototypeOf(Int8Array).from = () => 'pwned';",
+      "Int8Array.from([1]).length === 1" },
+    { "Object.getPrototypeOf(function *() {}).constructor.leak = 1;",
+      "!('leak' in Object.getPrototypeOf(function *() {}).constructor)" },
+    { "Object.getPrototypeOf(async function () {}).constructor.leak = 1;",
+      "!('leak' in Object.getPrototypeOf(async function () {}).constructor)" },
+    { "Object.getPrototypeOf(async function *() {}).constructor.leak = 1;",
+      "!('leak' in Object.getPrototypeOf(async function *() {}).constructor)" },
+    { "Object.setPrototypeOf(Object.getPrototypeOf(Int8Array), null);",
+      "Object.getPrototypeOf(Object.getPrototypeOf(Int8Array)) ==="
+      " Function.prototype" },
+    { "Object.getPrototypeOf([][Symbol.iterator]()).next = null;",
+      "[...[1, 2]].length === 2" },
+};
+
+static int eval_bool(JSContext *ctx, const char *src)
+{
+    JSValue val;
+    int ret;
+
+    val = JS_Eval(ctx, src, strlen(src), "<test>", JS_EVAL_TYPE_GLOBAL);
+    if (JS_IsException(val)) {
+        JSValue exc = JS_GetException(ctx);
+        const char *str = JS_ToCString(ctx, exc);
+        fprintf(stderr, "exception: %s\n", str ? str : "?");
+        JS_FreeCString(ctx, str);
+        JS_FreeValue(ctx, exc);
+        return -1;
+    }
+    ret = JS_ToBool(ctx, val);
+    JS_FreeValue(ctx, val);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    JSRuntime *rt;
+    JSContext *ctx;
+    JSContextSnapshot *snap;
+    int i, failed = 0;
+
+    rt = JS_NewRuntime();
+    ctx = JS_NewContext(rt);
+    snap = JS_NewContextSnapshot(ctx);
+    if (!snap) {
+        fprintf(stderr, "JS_NewContextSnapshot failed\n");
+        return 1;
+    }
+    for(i = 0; i < countof(tests); i++) {
+        if (eval_bool(ctx, tests[i].mutate) < 0 ||
+            JS_RestoreContextSnapshot(ctx, snap) < 0 ||
+            eval_bool(ctx, tests[i].check) != 1) {
+            fprintf(stderr, "FAILED: %s\n", tests[i].mutate);
+            failed++;
+        }
+    }
+    JS_FreeContextSnapshot(ctx, snap);
+    JS_FreeContext(ctx);
+    JS_FreeRuntime(rt);
+    if (failed)
+        return 1;
+    printf("test_snapshot: %d tests passed\n", (int)countof(tests));
+    return 0;
+}